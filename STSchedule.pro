@@ -29,15 +29,22 @@ HEADERS += \
     include/json/json_valueiterator.inl \
     include/json/json_writer.h \
     include/layer.h \
+    include/layerdb.h \
     include/layerengine.h \
+    include/layertable.h \
     include/ltreenode.h \
     include/network.h \
     include/nns/nns.h \
     include/noc.h \
+    include/nocsim.h \
     include/partition.h \
     include/placement.h \
+    include/pool.h \
     include/sa.h \
+    include/scheval.h \
     include/schnode.h \
+    include/threadpool.h \
+    include/topology.h \
     include/util.h
 
 SOURCES += \
@@ -51,7 +58,9 @@ SOURCES += \
     src/json/json_value.cpp \
     src/json/json_writer.cpp \
     src/layer.cpp \
+    src/layerdb.cpp \
     src/layerengine.cpp \
+    src/layertable.cpp \
     src/ltreenode.cpp \
     src/main.cpp \
     src/network.cpp \
@@ -68,10 +77,15 @@ SOURCES += \
     src/nns/vgg.cpp \
     src/nns/zfnet.cpp \
     src/noc.cpp \
+    src/nocsim.cpp \
     src/partition.cpp \
     src/placement.cpp \
+    src/pool.cpp \
     src/sa.cpp \
+    src/scheval.cpp \
     src/schnode.cpp \
+    src/threadpool.cpp \
+    src/topology.cpp \
     src/util.cpp
 
 INCLUDEPATH += include/
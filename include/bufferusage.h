@@ -8,6 +8,7 @@
 #include <iostream>
 #include <unordered_map>
 
+#include "pool.h"
 #include "util.h"
 
 
@@ -16,7 +17,8 @@ class BufferUsage{
 private:
 	// usage: records size of used buffer on each core
 	// usage[core] = used_buffer_size_on_this_core
-	std::unordered_map<pos_t, vol_t, pos_hash> usage;
+	std::unordered_map<pos_t, vol_t, pos_hash, std::equal_to<pos_t>,
+		PoolAllocator<std::pair<const pos_t, vol_t>>> usage;
 
 	// capacity: maximal volume of each buffer
 	vol_t capacity;
@@ -54,6 +56,12 @@ public:
 	// Get maximal capacity of buffer.
 	vol_t get_capacity() const;
 
+	// Calls f(core, size) for each core in usage.
+	template<typename F>
+	void for_each(F f) const{
+		for(const auto& x : usage) f(x.first, x.second);
+	}
+
 	friend std::ostream& operator<<(std::ostream& os, const BufferUsage& usage);
 };
 
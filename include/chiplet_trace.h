@@ -8,6 +8,7 @@
 #define CHIPLET_TRACE_H
 
 #include <deque>
+#include <iostream>
 #include <map>
 #include <set>
 #include <string>
@@ -93,6 +94,10 @@ struct FullTrace {
 
   // Output trace to stream
   void print(std::ostream &os) const;
+
+  // Read a trace written by print(), computations are skipped.
+  // Throws std::invalid_argument if the trace is malformed.
+  void read(std::istream &is);
 };
 
 // Generator class
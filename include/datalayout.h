@@ -3,6 +3,7 @@
  *  UniqueLayout:  base class for data layouts without duplication
  *  StdDataLayout: standard implementation of DataLayout
  *  StdULayout:    standard implementation of UniqueLayout
+ *  MemULayout:    layout of an ofmap stored in DRAM ports
  *
  *  One can add their own implementation of data layouts as classes here.
  */
@@ -181,6 +182,7 @@ class StdDataLayout : public DataLayout{
 private:
 	/*
 	 * rangeArr (len = range_len): stores data ranges
+	 *   (allocated with tot_len entries, so setBcast() needs no realloc)
 	 * contPosArr (len = tot_len): stores placed cores
 	 * posArr: similar to contPosArr, but used before "finalize()"
 	 *
@@ -262,19 +264,25 @@ public:
 };
 
 /*
+ * Layout of an ofmap stored in DRAM.
+ *
+ * Each range of the ofmap layout of the producer is stored on one DRAM port,
+ * the one nearest to the core that produces it (see NoC::nearest_dram).
+ * Entries are the same as the ofmap layout, with tiles replaced by DRAM ports.
+ *
+ * MemULayout is only a view of the ofmap layout, which must outlive it.
+ */
 class MemULayout : public UniqueLayout{
-	friend StdLayerEngine;
-private:
-	fmap_range range;
-	pos_t* posArr;
+	const StdULayout& ofmLayout;
 public:
-	MemULayout(const fmap_range& _range, pos_t* _posArr, len_t memLen);
-	// virtual void init(const PartSch& sch) override;
+	explicit MemULayout(const StdULayout& _ofmLayout);
 	virtual UniqueLayout* clone() const override;
+	virtual void finalize() override;
 	virtual void reset() override;
 	virtual UniqueEntry operator[](dataLen_t idx) const override;
-	//~MemULayout();
+
+	// The ofmap layout (tiles are cores) of this layout.
+	const StdULayout& getOfmL() const;
 };
-*/
 
 #endif // DATALAYOUT_H
@@ -0,0 +1,111 @@
+/* This file contains
+ *	LayerDB: Persistent database of layer schemes, shared across runs.
+ *
+ * The database is a hash table in a memory-mapped file. Each entry maps
+ * the key of an LNode search (hash of the config, layer, cluster, batch,
+ * to_dram and placement of prevs, see StdLayerEngine::dbKey) to the best
+ * partition, placement order & generator and its cost. The other parts
+ * of the scheme (layouts, NoC and tiling) are re-calculated from them.
+ *
+ * VERSION is stored in the file, and must be increased when the cost model
+ * or the key changes. Files with another version are cleared when opened.
+ *
+ * Entries are never removed. When the table is 3/4 full, new entries are
+ * dropped. Only one process should use a file at the same time.
+ */
+
+#ifndef LAYERDB_H
+#define LAYERDB_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <string>
+
+#include "partition.h"
+#include "util.h"
+
+
+class LayerDB{
+public:
+	typedef std::uint64_t hash_t;
+
+	static constexpr std::uint32_t VERSION = 3;
+
+	// Two independent hashes of a key, "check" guards against collisions of "key".
+	struct Key{
+		hash_t key, check;
+	};
+
+	// Incremental (FNV-1a) hash of a key.
+	class Hasher{
+		hash_t h1, h2;
+		void addByte(std::uint8_t byte);
+	public:
+		explicit Hasher(hash_t seed = 0);
+		// Adds the bytes of a trivially copyable value.
+		template<typename T>
+		Hasher& add(const T& val){
+			const auto* p = reinterpret_cast<const std::uint8_t*>(&val);
+			for(std::size_t i = 0; i < sizeof(T); ++i) addByte(p[i]);
+			return *this;
+		}
+		Hasher& add(const std::string& str);
+		Key get() const;
+	};
+
+	struct Record{
+		// Whether the layer has a valid scheme.
+		bool valid;
+		std::uint8_t order[4];
+		// PlaceGen of the placement.
+		std::uint8_t gen;
+		PartSch part;
+		energy_t energy, extUbufEnergy;
+		cycle_t time;
+	};
+
+private:
+	struct Header;
+	struct Slot;
+
+	Header* header;
+	Slot* slots;
+	std::size_t mapSize;
+	int fd;
+	hash_t config;
+	std::mutex lock;
+
+	std::atomic<std::uint64_t> numHits, numMisses, numDropped;
+
+	// Slot of *key*: either the slot with the same key or an empty slot.
+	Slot* findSlot(const Key& key) const;
+
+public:
+	LayerDB();
+	LayerDB(const LayerDB&) = delete;
+	LayerDB& operator=(const LayerDB&) = delete;
+	~LayerDB();
+
+	/*
+	 * Opens (or creates) the database at *path*.
+	 * *config_hash* identifies the global config (core, costs, NoC, ...),
+	 * and is added to all keys.
+	 */
+	void open(const std::string& path, hash_t config_hash, std::size_t capacity = 1 << 18);
+	void close();
+	bool is_open() const;
+
+	// Hasher of a new key (with the config hash).
+	Hasher hasher() const;
+
+	// Returns whether *key* is found, and stores its record in *rec*.
+	bool find(const Key& key, Record& rec);
+	void insert(const Key& key, const Record& rec);
+
+	void print_stats(std::ostream& os = std::cout) const;
+}extern layerDB; // Global layer database to use.
+
+#endif // LAYERDB_H
@@ -2,6 +2,7 @@
  *	LayerScheme:    whole scheme of scheduling a layer
  *  LayerEngine:    base class for searching LayerScheme
  *  StdLayerEngine: standard implementation of LayerEngine
+ *  FastLayerEngine: StdLayerEngine on the top-k partitions only
  *
  *  One can add their own implementation of layer scheme searching as classes here.
  */
@@ -9,10 +10,19 @@
 #ifndef LAYERENGINE_H
 #define LAYERENGINE_H
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <vector>
+
 #include "coremapping.h"
+#include "layerdb.h"
 #include "noc.h"
 #include "placement.h"
 #include "schnode.h"
+#include "threadpool.h"
 #include "util.h"
 
 
@@ -43,17 +53,91 @@ public:
 class StdLayerEngine : public LayerEngine{
 	CoreMapper* mapper;
 
+	// Statistics of pruning in search(), shared by all threads.
+	struct PruneStats{
+		// #partitions with valid intra-tile dataflow.
+		std::atomic<std::uint64_t> numParts{0};
+		// #partitions skipped by their lower bound.
+		std::atomic<std::uint64_t> numPruned{0};
+		// #placement loops stopped early by the lower bound.
+		std::atomic<std::uint64_t> numCut{0};
+	};
+	mutable PruneStats stats;
+
+	// Counters of one search(), added to stats at the end.
+	struct PruneCnt{
+		std::uint64_t numParts = 0, numPruned = 0, numCut = 0;
+	};
+
+	// Pool for searching partitions in parallel (nullptr for serial search).
+	std::unique_ptr<ThreadPool> pool;
+
+	// Allocates layouts of *place* for a layer on *numCores* cores.
+	static void initPlaceSch(PlaceSch& place, cidx_t numCores, bool hasWgt);
+	// Returns the per-thread scratch PlaceSch (with layouts) used in the search loop.
+	static PlaceSch& scratchPlaceSch(cidx_t numCores, bool hasWgt);
+
+	// Searches all placements of partition *place.part*, updates *layerSch* if a better one is found.
+	void searchPart(LNode* curNode, PlaceSch& place, LayerScheme& layerSch, PruneCnt& cnt) const;
+
+	// Searches partitions parts[0, numParts) with pool, updates *layerSch* as searchPart().
+	void searchParts(LNode* curNode, const PartSch* parts, std::size_t numParts, LayerScheme& layerSch, PruneCnt& cnt) const;
+
 	// Sets placement *place* when partition *place.part* is fixed
 	void initLayouts(PlaceSch& place, const Node& layerT, const fmap_shape& ofmShape, len_t B) const;
 
 	// Calculates NoC *noc* from current placement *place*
-	void calcNoC(NoC& noc, const PlaceSch& place, LNode* curNode) const;
+	void calcNoC(NoC& noc, const PlaceSch& place, const LNode* curNode) const;
+
+	// Sets the core of each tile in *alignPos* for PlaceGen::ALIGN, from the transfers in *traffic*.
+	// Returns false if no tile receives data from a single core or DRAM port.
+	static bool alignPlacement(const PlaceSch& place, const NoC::Traffic& traffic, const Cluster& cluster, pos_t* alignPos);
+
+	// Searches the scheme of *curNode* (without layerDB).
+	LayerScheme searchScheme(LNode* curNode) const;
+	// Re-calculates layouts, placement and NoC of *layerSch* from its part and order.
+	// The NoC uses the routing (in NoC::routing_mask) with the smallest max link.
+	void initScheme(LNode* curNode, LayerScheme& layerSch) const;
+	// Key of *curNode* in layerDB.
+	LayerDB::Key dbKey(const LNode* curNode) const;
+
+protected:
+	// Only the first *top_k* partitions after rankParts() are searched (0 for all).
+	// The others are searched only if none of them is valid.
+	const std::size_t top_k;
+
+	StdLayerEngine(CoreMapper* _mapper, std::size_t num_threads, std::size_t _top_k);
+
+	// Sorts *parts* from the most promising one, used when top_k > 0.
+	virtual void rankParts(LNode* curNode, std::vector<PartSch>& parts) const;
 
 public:
-	StdLayerEngine(CoreMapper* _mapper);
+	// Partitions of each layer are searched with *num_threads* threads.
+	StdLayerEngine(CoreMapper* _mapper, std::size_t num_threads = 1);
 
 	virtual vol_t get_ubuf_size() const override;
 	virtual LayerScheme search(LNode* curNode) const override;
+
+	// Records all transfers of the NoC of *node* (with its final placement) into *traffic*.
+	void record_traffic(const LNode* node, NoC::Traffic& traffic) const;
+
+	// Prints statistics of pruned partitions/placements.
+	void print_stats(std::ostream& os = std::cout) const;
+};
+
+/*
+ * FastLayerEngine: only searches the top-k partitions ranked by a cheap
+ * utilization & data replication heuristic (see rankParts()).
+ *
+ * Its schemes are never better than StdLayerEngine, and are used by SA
+ * in the exploration (high temperature) rounds only.
+ */
+class FastLayerEngine : public StdLayerEngine{
+protected:
+	virtual void rankParts(LNode* curNode, std::vector<PartSch>& parts) const override;
+
+public:
+	FastLayerEngine(CoreMapper* _mapper, std::size_t _top_k, std::size_t num_threads = 1);
 };
 
 #endif // LAYERENGINE_H
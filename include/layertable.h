@@ -0,0 +1,69 @@
+/* This file contains
+ *	LayerTable: Static infos of all layers, precomputed at startup.
+ *
+ * Many values used in StdLayerEngine::search only depend on the layer,
+ * the cluster size and the batch size, e.g. the lower bound of buffer usage,
+ * minimal #cuts and the list of valid partitions (from PartEngine).
+ * LayerTable computes them once for all (layer, #cores, batch) tuples,
+ * so that each search only reads them from flat tables.
+ *
+ * Partitions are stored as indices into PartEngine::all_parts().
+ * The batch sizes in the table are all divisors of the total batch.
+ * For other tuples get() returns nullptr, and search computes them as before.
+ */
+
+#ifndef LAYERTABLE_H
+#define LAYERTABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "partition.h"
+#include "util.h"
+
+
+class LayerTable{
+public:
+	struct Entry{
+		// Whether the layer fits in ubuf (lower bound of ubuf usage on one core).
+		bool fits;
+		// Minimal cuts on ifmap, see StdLayerEngine::search.
+		len_t minCuts;
+		// Valid partitions are partIdx[partBegin, partEnd).
+		std::uint32_t partBegin, partEnd;
+	};
+
+private:
+	cidx_t maxCores;
+	// All batch sizes in the table, and index of each batch size (-1 if none).
+	std::vector<len_t> batches;
+	std::vector<int> batchIdx;
+
+	// entries[(layer * maxCores + numCores - 1) * batches.size() + batch_index]
+	std::vector<Entry> entries;
+	std::vector<std::uint16_t> partIdx;
+
+	std::size_t index(lid_t layer, cidx_t numCores, std::size_t bIdx) const;
+
+public:
+	LayerTable();
+
+	/*
+	 * Computes the tables of all layers in *network*, with at most
+	 * *max_cores* cores and *tot_batch* batches in total.
+	 * Layers are computed in parallel with *num_threads* threads.
+	 */
+	void init(cidx_t max_cores, len_t tot_batch, vol_t ubuf_size, std::size_t num_threads = 1);
+
+	// Returns the entry of (layer, numCores, B), or nullptr if not in the table.
+	const Entry* get(lid_t layer, cidx_t numCores, len_t B) const;
+
+	// Appends all valid partitions of *entry* (with *numCores* cores) to *parts*.
+	void get_parts(const Entry& entry, cidx_t numCores, std::vector<PartSch>& parts) const;
+
+	// Total size of the tables (in bytes).
+	std::size_t size() const;
+}extern layerTable; // Global layer table to use.
+
+#endif // LAYERTABLE_H
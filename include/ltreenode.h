@@ -11,6 +11,7 @@
 #include <vector>
 
 #include "bitset.h"
+#include "pool.h"
 #include "util.h"
 
 class SAEngine;
@@ -27,7 +28,7 @@ public:
 		L  // LNode
 	};
 
-	typedef std::vector<LTreeNode*> node_vec;
+	typedef std::vector<LTreeNode*, PoolAllocator<LTreeNode*>> node_vec;
 
 private:
 	// Type of node.
@@ -53,6 +54,8 @@ private:
 
 	// Only for LNode.
 	bool to_dram;
+	// Whether weights are re-fetched in each batch group (instead of pinned).
+	bool wgt_stream;
 	// Direct prevs.
 	Bitset dirp_set;
 
@@ -79,6 +82,10 @@ public:
 	LTreeNode(const LTreeNode& node)=default;
 	~LTreeNode();
 
+	// All LTreeNodes are allocated from MemPool.
+	static void* operator new(std::size_t size){ return MemPool::alloc(size); }
+	static void operator delete(void* ptr, std::size_t size){ MemPool::free(ptr, size); }
+
 	// Initialize the whole tree from the root.
 	void init_root();
 
@@ -94,6 +101,9 @@ public:
 	// Reset layer_set (for re-calculation)
 	void reset_lset();
 
+	// Sets whether weights are streamed (only for LNode).
+	void set_wgt_stream(bool stream);
+
 	// Getter functions.
 	NodeType get_type();
 	const node_vec& get_children();
@@ -105,6 +115,7 @@ public:
 	const std::vector<lid_t>& get_stages() const;
 	lid_t get_num_stage() const;
 	bool get_to_dram() const;
+	bool get_wgt_stream() const;
 	const Bitset& get_dirp_set() const;
 };
 
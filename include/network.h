@@ -56,6 +56,10 @@ class Node{
 	// #channels that comes from InputData
 	len_t external_C;
 
+	// Lower bounds of the ifmap/weight volume (of one batch) that
+	// any partition needs to hold on-chip. See Node::Node().
+	vol_t min_ifm_vol, min_wgt_vol;
+
 public:
 	Node(const Layer* _l, const Bitset& _ifmPrevs, len_t _external_C, bwidth_t width = 0, const Bitset& _wgtPrevs = {});
 	Node(const Node& n) = delete;
@@ -74,6 +78,10 @@ public:
 	// Whether weight comes from prev layer's fmap (e.g. in GroupConv)
 	bool hasWgtPrevs() const;
 
+	// Lower bounds of the total ifmap/weight volume of B batches on all cores.
+	vol_t get_min_ifm_vol(len_t B) const;
+	vol_t get_min_wgt_vol(len_t B) const;
+
 	// Adds l to "nexts"
 	void add_next(lid_t l);
 
@@ -5,14 +5,17 @@
 #ifndef NOC_H
 #define NOC_H
 
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
+#include <utility>
 #include <vector>
-#include <unordered_map>
 
 #include "util.h"
 
 class DataLayout;
 class UniqueLayout;
+class MemULayout;
 //#include "datalayout.h"
 
 
@@ -20,6 +23,82 @@ class NoC{
 public:
 	typedef vol_t hop_t;
 
+	/*
+	 * Routing of unicasts (multicasts use the XY tree, or trunk trees with steiner).
+	 *
+	 *   XY:       Along x first, then along y.
+	 *   YX:       Along y first, then along x.
+	 *   O1TURN:   Half of the data is routed XY, and the other half YX.
+	 *   ADAPTIVE: XY or YX, whichever has the smaller max #hops on its links
+	 *             when the unicast is added (only with calc_bw).
+	 *
+	 * All routings are minimal, so only the hops on each link differ.
+	 */
+	enum class Routing : std::uint8_t{
+		XY, YX, O1TURN, ADAPTIVE, NUM
+	};
+
+	/*
+	 * Traffic: all transfers added to a NoC, with the data layouts
+	 * and indices of ranges instead of the positions of tiles.
+	 *
+	 * With a fixed partition, changing the placement only moves the tiles,
+	 * so replaying the recorded traffic (see NoC::replay) gives the same
+	 * result as adding all transfers again, without re-calculating
+	 * ranges, intersections and volumes.
+	 */
+	class Traffic{
+		friend NoC;
+
+		enum class Kind : std::uint8_t{
+			FROM_DRAM,	// DRAM -> range "idx" of "layout"
+			TO_DRAM,	// tile "idx" of "layout" (UniqueLayout) -> DRAM
+			BETWEEN,	// "src" -> range "idx" of "layout"
+			FROM_MEM,	// DRAM port "src" -> range "idx" of "layout"
+			TO_MEM,		// tile "idx" of "layout" (UniqueLayout) -> its nearest DRAM port
+			DIV,		// NoC::div("size")
+		};
+
+		struct Flow{
+			Kind kind;
+			cidx_t idx;
+			pos_t src;
+			vol_t size;
+			const DataLayout* layout;
+		};
+
+		std::vector<Flow> flows;
+
+	public:
+		// A transfer of *size* data from core (or DRAM port) *src* to all cores in *dst*.
+		struct Transfer{
+			pos_t src;
+			std::vector<pos_t> dst;
+			double size;
+			// Index of the DRAM port (in dram_list) that is accessed, -1 if none.
+			int port;
+		};
+
+		void clear();
+
+		/*
+		 * Appends all transfers with the current tile positions to *transfers*.
+		 * Transfers from/to DRAM are split on all DRAM ports (or use the nearest
+		 * port with dram_layout) as in NoC, and divided as NoC::div does.
+		 */
+		void get_transfers(std::vector<Transfer>& transfers) const;
+
+		// Calls f(layout, idx, src, size) for each transfer from a core or
+		// DRAM port "src" to range "idx" of "layout" (BETWEEN & FROM_MEM).
+		template<typename F>
+		void for_each_src(F f) const{
+			for(const Flow& flow: flows){
+				if(flow.kind == Kind::BETWEEN || flow.kind == Kind::FROM_MEM)
+					f(flow.layout, flow.idx, flow.src, flow.size);
+			}
+		}
+	};
+
 	/*
 	 * Global variables
 	 *
@@ -28,20 +107,73 @@ public:
 	 * DRAM_bw:       DRAM bandwidth (#data / cycle)
 	 * NoC_bw:        NoC bandwidth (#data / cycle)
 	 * dram_list:     List of all DRAM ports
+	 * dram_port_bw:  Bandwidth of each port in dram_list (#data / cycle).
+	 *                When empty, all ports share DRAM_bw. Otherwise DRAM
+	 *                time is bounded by the busiest port.
+	 * dram_layout:   Whether ofmaps in DRAM are stored with MemULayout
+	 *                (each tile on the DRAM port nearest to its core),
+	 *                instead of interleaved on all DRAM ports.
+	 * routing_mask:  Bitmask of Routing tried for each layer, the one with
+	 *                the smallest max link is used (see StdLayerEngine).
+	 * steiner:       Whether multicasts use the cheapest trunk tree (see
+	 *                steinerCalc) instead of the XY tree.
 	 */
 	static energy_t hop_cost, DRAM_acc_cost;
 	static bw_t DRAM_bw, NoC_bw;
 	static std::vector<pos_t> dram_list;
+	static std::vector<bw_t> dram_port_bw;
+	static bool dram_layout;
+	static std::uint8_t routing_mask;
+	static bool steiner;
+
+	// The DRAM port (in dram_list) nearest to "core".
+	static const pos_t& nearest_dram(pos_t core);
+	// Index of the DRAM port nearest to "core", and of the port at "port".
+	static std::size_t nearest_dram_idx(pos_t core);
+	static std::size_t dram_idx(pos_t port);
+
+	/*
+	 * Links of the route from src to dst[0, len) (a multicast if len > 1)
+	 * with *routing* (not ADAPTIVE), as (link index, fraction of the data
+	 * on the link). Link indices are the same as Topology::link_idx.
+	 */
+	static void get_route(pos_t src, const pos_t* dst, cidx_t len, Routing routing, std::vector<std::pair<std::int32_t, double>>& links);
+
+	/*
+	 * Calculate the volume of intersection between "rng1" and "rng2"
+	 * The batch dimension of "rng1/2" is in [0, bat1/2)
+	 * Returned value corresponds to bat2 batches.
+	 */
+	static vol_t calc_intersect(const fmap_range& rng1, const fmap_range& rng2, len_t bat1, len_t bat2);
 
-private:
 	// Records hop count (#hops) of all links
 	class HopCount{
 		friend NoC;
 
 		typedef std::int32_t linkIdx_t;
 
-		// link_hops[link_id] = hops_on_link_id
-		std::unordered_map<linkIdx_t, hop_t> link_hops;
+		/*
+		 * link_hops[link_id] = hops_on_link_id
+		 *
+		 * Dense array of all num_dirs() * xlen * ylen links (4 or 8 directions,
+		 * see Topology::link_idx and get_idx),
+		 * allocated when the first hop is added (empty before).
+		 *
+		 * Straight paths are added to *line_diff* (see add_line) instead,
+		 * and moved into link_hops by flush() before link_hops is read.
+		 */
+		mutable std::vector<hop_t> link_hops;
+		/*
+		 * line_diff: difference arrays of links in each row and column,
+		 * with the same index as link_hops. For E/W (dir 0/2) links, entry
+		 * (x, y, dir) is the difference between links (x, y) and (x-1, y),
+		 * and for N/S (dir 1/3) links, between (x, y) and (x, y-1).
+		 *
+		 * Unsigned overflow of negative differences cancels in prefix sums.
+		 */
+		mutable std::vector<hop_t> line_diff;
+		// Whether line_diff has pending hops.
+		mutable bool pending;
 		/*
 		 * factor: for faster mult (lazy update).
 		 *
@@ -63,11 +195,27 @@ private:
 
 		// Maximal #hops of one link.
 		hop_t max() const;
-
-		// Gets #hops on the link from (x, y) to direction dir.
-		hop_t& get(mlen_t x, mlen_t y, mlen_t dir);
+		// Maximal #hops of one local link and of one D2D link.
+		void max(hop_t& local, hop_t& d2d) const;
+		// #hops on link *idx*.
+		hop_t get(linkIdx_t idx) const;
+		// Maximal #hops on local links at positions [from, to] to direction dir
+		// (in the same row/column as *pos*).
+		hop_t line_max(pos_t pos, mlen_t dir, int from, int to) const;
+
+		// Allocates link_hops and line_diff.
+		void alloc();
+		// Adds *size* hops on link *idx*.
+		void add(linkIdx_t idx, hop_t size);
+		// Adds *size* hops on local links at positions [from, to] to direction dir
+		// (in the same row/column as *pos*), in O(1).
+		void add_line(pos_t pos, mlen_t dir, int from, int to, hop_t size);
+
+		// Moves pending hops in line_diff into link_hops (prefix sums).
+		void flush() const;
 
 		// Conversion between (x, y, dir) and link_idx
+		static linkIdx_t num_links();
 		static linkIdx_t get_idx(mlen_t x, mlen_t y, mlen_t dir);
 		static void get_dir(linkIdx_t link_idx, mlen_t& x, mlen_t& y, mlen_t& dir);
 
@@ -78,24 +226,37 @@ private:
 		void flat_factor();
 	};
 
+private:
+
 	// Whether calculates hops on each link.
 	// When set to false, only calculate total hops.
 	bool calc_bw;
 
-	// Total count of hops and DRAM access
-	hop_t tot_hops;
+	// Routing of unicasts, only used when calc_bw = true.
+	Routing routing;
+
+	// Total count of hops (including D2D hops) and DRAM access
+	hop_t tot_hops, tot_d2d_hops;
 	access_t tot_DRAM_acc;
+	// DRAM access of each port in dram_list (only used with dram_port_bw).
+	std::vector<access_t> port_acc;
 
 	// Hops on each link (only used when calc_bw = true)
-	// Direction: ESWN = 0123
+	// Direction: ESWN = 0123, and express links 4567 (see Topology)
 	HopCount link_hops;
 
-	/*
-	 * Calculate the volume of intersection between "rng1" and "rng2"
-	 * The batch dimension of "rng1/2" is in [0, bat1/2)
-	 * Returned value corresponds to bat2 batches.
-	 */
-	static vol_t calc_intersect(const fmap_range& rng1, const fmap_range& rng2, len_t bat1, len_t bat2);
+	// All transfers are recorded into *rec* (if not nullptr).
+	Traffic* rec;
+
+	// Adds *size* DRAM access on port *port* (in dram_list).
+	void add_port_acc(std::size_t port, access_t size);
+
+	// Adds a straight path, see noc.cpp.
+	hop_t lineCalc(pos_t from, bool alongX, int delta, vol_t size, bool useExpress);
+	// Adds the route from src to dst (x first if *xFirst*), returns #links.
+	hop_t routeCalc(pos_t src, pos_t dst, vol_t size, bool xFirst);
+	// Maximal #hops on the links of the route from src to dst.
+	hop_t routeMax(pos_t src, pos_t dst, bool xFirst) const;
 
 	// Functions for unicast/multicast calc
 	// Notice: for multiple dests, *dst* needs to be in increasing order.
@@ -103,6 +264,7 @@ private:
 	hop_t unicastCalc(pos_t src, pos_t dst, vol_t size);
 	void multicast(pos_t src, const pos_t* dst, cidx_t len, vol_t size);
 	hop_t multicastCalc(pos_t src, const pos_t* dst, cidx_t len, vol_t size);
+	hop_t steinerCalc(pos_t src, const pos_t* dst, cidx_t len, vol_t size);
 	void unicast_from_dram(pos_t dst, vol_t size);
 	void unicast_to_dram(pos_t src, vol_t size);
 	void multicast_from_dram(const pos_t* dst, cidx_t len, vol_t size);
@@ -128,12 +290,29 @@ public:
 	// Clear all noc data.
 	void clear();
 
+	// Routing of all following unicasts.
+	void set_routing(Routing r);
+	Routing get_routing() const;
+
+	// Records all following transfers into *traffic* (stops if nullptr).
+	void record(Traffic* traffic);
+	// Clears and re-adds all transfers in *traffic* with current tile positions.
+	void replay(const Traffic& traffic);
+
 	// DRAM -> toLayout
 	void fromRemoteMem(const DataLayout& toLayout);
 	// DRAM -> toLayout, only channels in [fromC, toC) is fetched
 	void fromRemoteMem(const DataLayout& toLayout, len_t fromC, len_t toC);
 	// fromLayout -> DRAM
 	void toRemoteMem(const UniqueLayout& fromLayout);
+	// ofmap layout of memLayout -> DRAM ports of memLayout
+	void toRemoteMem(const MemULayout& memLayout);
+	/*
+	 * DRAM ports of memLayout -> toLayout
+	 *
+	 * fromCOffset, fromB and toB are the same as in betweenLayout.
+	 */
+	void fromRemoteMem(const MemULayout& memLayout, const DataLayout& toLayout, len_t fromCOffset, len_t fromB, len_t toB);
 	/*
 	 * fromLayout -> toLayout
 	 *
@@ -145,6 +324,12 @@ public:
 
 	// Getter functions.
 	cycle_t get_time() const;
+	/*
+	 * Lower bound of the DRAM time, which doesn't depend on placement:
+	 * total DRAM access over the total bandwidth of all DRAM ports.
+	 * (With dram_port_bw, the busiest port can only be slower.)
+	 */
+	cycle_t get_DRAM_time_bound() const;
 	energy_t get_cost() const;
 	energy_t get_hop_cost() const;
 	energy_t get_DRAM_cost() const;
@@ -156,10 +341,16 @@ public:
 	// Prints noc information
 	friend std::ostream& operator<<(std::ostream& os, const NoC& noc);
 
+	// DRAM access of each port in dram_list, empty without dram_port_bw.
+	const std::vector<access_t>& get_port_acc() const;
+
 	// Pretty link hops
 	struct link_info{
 		pos_t from, to;
 		hop_t total_hops;
+		// Link direction (see link_hops) and whether it is a D2D link.
+		mlen_t dir;
+		bool d2d;
 
 		bool operator<(const link_info& other) const;
 		bool operator==(const link_info& other) const;
@@ -0,0 +1,145 @@
+/* This file contains
+ *	NoCSim: Flow-level NoC simulator, to validate the analytic NoC time.
+ *
+ * NoC::get_time() assumes that all transfers of a segment overlap perfectly,
+ * so that the busiest link (or DRAM port) bounds the time. NoCSim replays
+ * the transfers as flows on a model with finite bandwidth and buffering:
+ *
+ *   - Resources are all links (NoC_bw, or d2d_bw on D2D links) and all
+ *     DRAM ports (dram_port_bw, or an equal share of DRAM_bw).
+ *   - Each flow takes the same route as in NoC, a multicast carries its data
+ *     once on each link of its tree. ADAPTIVE picks XY or YX with the smaller
+ *     max load of the flows added before, as NoC does.
+ *   - The bandwidth of each resource is shared with max-min fairness,
+ *     and rates are re-calculated when a flow starts or finishes.
+ *   - Each link has *channels* buffers (0 means unlimited), and a flow only
+ *     starts when all links on its route have a free buffer. Waiting flows
+ *     start in order of arrival.
+ *
+ * The load of each resource is recorded over time in a fixed number of
+ * buckets, whose width is doubled when the time exceeds all buckets.
+ */
+
+#ifndef NOCSIM_H
+#define NOCSIM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "chiplet_trace.h"
+#include "noc.h"
+#include "util.h"
+
+class SchEval;
+class StdLayerEngine;
+
+
+class NoCSim{
+public:
+	// (resource, data on the resource per data of the flow)
+	typedef std::vector<std::pair<std::int32_t, double>> res_list;
+
+private:
+	struct Flow{
+		res_list res;
+		double size, left, rate;
+		double start, end;
+	};
+
+	std::size_t channels;
+	std::size_t num_buckets;
+	// Capacity (#data / cycle) of each resource, links first (see Topology::link_idx), then DRAM ports.
+	std::vector<double> cap;
+
+	std::vector<Flow> flows;
+	// Running flows, and waiting flows in order of arrival.
+	std::vector<std::size_t> running, waiting;
+	// #running flows and total rate on each resource.
+	std::vector<std::size_t> num_running;
+	std::vector<double> usage;
+	// Load of all added flows on each resource (used by ADAPTIVE).
+	std::vector<double> added;
+	double now;
+
+	// load[res * num_buckets + b]: data on "res" in time [b * width, (b+1) * width).
+	std::vector<double> load;
+	double width;
+
+	// Index of the resource of DRAM port *port*.
+	static std::int32_t port_res(std::size_t port);
+	// Adds the route of *transfer* (with *routing*) to *res*.
+	void route(const NoC::Traffic::Transfer& transfer, NoC::Routing routing, res_list& res) const;
+
+	// Starts flow *id* if buffers are free on all its links.
+	bool try_start(std::size_t id);
+	// Re-calculates the rates of all running flows.
+	void update_rates();
+	// Adds the load of all resources in [now, now + dt).
+	void add_load(double dt);
+
+public:
+	explicit NoCSim(std::size_t _channels = 0, std::size_t _num_buckets = 64);
+
+	// Removes all flows and sets time to 0.
+	void reset();
+
+	/*
+	 * Adds a flow of *size* data on resources *res* at current time,
+	 * returns its id. Flows without resources are done at once.
+	 */
+	std::size_t add_flow(const res_list& res, double size);
+	// Adds a flow of *transfer*, routed with *routing*.
+	std::size_t add_flow(const NoC::Traffic::Transfer& transfer, NoC::Routing routing);
+
+	/*
+	 * Runs until the next flows are done, and stores them in *done*.
+	 * Returns false if no flow is running.
+	 */
+	bool step(std::vector<std::size_t>& done);
+	// Runs until all flows are done.
+	void run();
+
+	double get_time() const;
+	std::size_t num_flows() const;
+	bool is_done(std::size_t id) const;
+	// Latency of flow *id*, only valid after it is done.
+	double get_latency(std::size_t id) const;
+
+	// Prints the flow latency and the busiest resources.
+	void print_stats(std::ostream& os, std::size_t top = 5) const;
+	/*
+	 * Prints a CSV row of each resource in each non-empty bucket, with
+	 * *label* as the first column (see print_header).
+	 * "occupancy" is the load divided by the capacity of the bucket.
+	 */
+	void print_occupancy(std::ostream& os, const std::string& label) const;
+	static void print_header(std::ostream& os);
+
+	/*
+	 * Simulates each segment of the scheme in *eval* (after eval()),
+	 * with the transfers of all its layers (times their #bgrp in the
+	 * segment) starting at time 0, which is what NoC::get_time() models.
+	 *
+	 * Prints the analytic and simulated time of each segment into *os*,
+	 * and the occupancy of each segment into *csv*.
+	 */
+	void simulate(const SchEval& eval, const StdLayerEngine& engine, std::ostream& os, std::ostream& csv);
+
+	/*
+	 * Simulates *trace*, each chiplet runs its operations in order:
+	 *   SEND starts a flow (at most *max_sends* running flows of each
+	 *   chiplet, 0 for unlimited), RECV waits until its flow is done,
+	 *   RECV from DRAM fetches the data from the nearest DRAM port, and
+	 *   COMPUTE takes no time (the trace has no compute time).
+	 *
+	 * Sizes in the trace are in bytes, each data is *data_bytes* bytes.
+	 * Unicasts are routed with the first routing in NoC::routing_mask.
+	 */
+	void simulate(const ChipletTrace::FullTrace& trace, std::size_t max_sends, vol_t data_bytes, std::ostream& os, std::ostream& csv);
+};
+
+#endif // NOCSIM_H
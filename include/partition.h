@@ -30,6 +30,8 @@ struct PartSch{
 	// Total size of partition: K * B * H * W
 	vol_t size() const;
 
+	bool operator==(const PartSch& other) const;
+
 	friend std::ostream& operator<<(std::ostream& os, const PartSch& sch);
 };
 
@@ -69,6 +71,9 @@ public:
 
 	// Returns the iterator for partition schemes of *cluster_size*, partition will be iterated in *sch*.
 	PartIter init(cidx_t cluster_size, len_t batch_num, const Node& layer, PartSch& sch, len_t min_cuts);
+
+	// All partitions of *cluster_size* cores (valid or not), in the order of PartIter.
+	static const std::vector<PartSch>& all_parts(cidx_t cluster_size);
 }extern partEngine; // Global partEngine to use.
 
 class PartIter{
@@ -20,6 +20,22 @@
 class Cluster;
 //#include "cluster.h"
 
+/*
+ * Generator of placements, i.e. how tiles are mapped to the cores of a cluster.
+ *
+ * ORDER:   tiles are mapped to the (strided) order of cores in the cluster.
+ * HILBERT: same as ORDER, but cores are sorted along a Hilbert curve.
+ * ZORDER:  same as ORDER, but cores are sorted along a Z-order (Morton) curve,
+ *          i.e. in recursively tiled 2x2 blocks.
+ * ALIGN:   each tile is placed on the free core nearest to the producer core
+ *          holding most of its input (see StdLayerEngine::alignPlacement).
+ *
+ * Each generator (except ALIGN) is combined with all orders of dimensions.
+ */
+enum class PlaceGen : std::uint8_t{
+	ORDER, HILBERT, ZORDER, ALIGN, NUM
+};
+
 
 struct PlaceSch{
 	// The underlying partition scheme
@@ -31,6 +47,9 @@ struct PlaceSch{
 	 */
 	std::uint8_t order[4];
 
+	// Generator of the placement.
+	PlaceGen gen = PlaceGen::ORDER;
+
 	// Data layouts of ifmap, weight and ofmap
 	std::unique_ptr<DataLayout> ifmLayout, wgtLayout;
 	std::unique_ptr<UniqueLayout> ofmLayout/*, memLayout*/;
@@ -51,11 +70,17 @@ struct PlaceSch{
 	const UniqueLayout& getOfmL() const;
 
 	// Initialize placement.
-	void initPlacement(const Cluster& cluster);
+	// With PlaceGen::ALIGN, *alignPos* is the core of each tile (in the order of ofmLayout).
+	void initPlacement(const Cluster& cluster, const pos_t* alignPos = nullptr);
 
-	// Update placement scheme from *sch*, only update "part" and "order".
+	// Update placement scheme from *sch*, only update "part", "order" and "gen".
 	void update(PlaceSch&& sch);
 
+	// Whether *sch* has the same "part", "order" and "gen",
+	// and with PlaceGen::ALIGN, the same core of each tile.
+	// (On the same cluster, this means the same layouts)
+	bool sameScheme(const PlaceSch& sch) const;
+
 	// See "notes about finalize()" in datalayout.h
 	void finalize();
 
@@ -66,10 +91,14 @@ class PlaceIter;
 
 class PlaceEngine{
 public:
+	// Bitmask of enabled generators, bit i is PlaceGen(i). (default: ORDER only)
+	static std::uint8_t gen_mask;
+
 	PlaceEngine()=default;
 
-	// Returns the iterator for placement schemes, which will be iterated in "cur_sch.order".
-	PlaceIter init(PlaceSch& cur_sch);
+	// Returns the iterator for placement schemes, which will be iterated in "cur_sch.order" and "cur_sch.gen".
+	// "low_bound" is a lower bound of the cost of all placements.
+	PlaceIter init(PlaceSch& cur_sch, cost_t low_bound = 0);
 }extern placeEngine;
 
 class PlaceIter{
@@ -77,13 +106,29 @@ class PlaceIter{
 
 	std::uint8_t perm_len;
 	bool hasNext;
+	// Whether the iteration is stopped by lowBound.
+	bool pruned;
+	cost_t lowBound;
 	PlaceSch& curSch;
+
+	// Sets the first enabled generator after *curSch.gen* (or from the first one if *first*).
+	bool nextGen(bool first);
 public:
-	PlaceIter(PlaceSch& placeSch);
+	PlaceIter(PlaceSch& placeSch, cost_t low_bound = 0);
 
-	// Next function for iterator, returns whether iterator is valid.
+	/*
+	 * Next function for iterator, returns whether iterator is valid.
+	 * "cost" is the best cost found so far, the iteration stops
+	 * when no placement can be better than it.
+	 */
 	bool nextPlace(cost_t cost = cost_inf);
 
+	// Updates the lower bound of the remaining placements.
+	void setLowBound(cost_t low_bound);
+
+	// Whether some placements are skipped by the lower bound.
+	bool is_pruned() const;
+
 	/**
 	 * @brief operator bool: same as "eof" in an IO stream.
 	 * Returns whether iterator is valid.
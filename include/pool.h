@@ -0,0 +1,97 @@
+/* This file contains
+ *	MemPool:       Thread-local pool for small objects of the RA Tree.
+ *	PoolAllocator: STL allocator that allocates from MemPool.
+ *
+ * Each SA chain runs in its own thread, and allocates/frees a lot of
+ * small tree nodes and containers in each round. MemPool keeps a free list
+ * for each size class in every thread, so these don't go through malloc
+ * (and don't contend on it between chains).
+ *
+ * Memory is taken from the system in chunks and never returned.
+ * A block can be freed by any thread, and will be reused by that thread.
+ * When a thread exits, its free lists are handed to a global list,
+ * and later threads refill from it (in bulk) before taking new chunks.
+ *
+ * The free lists of each thread are never destroyed, since pooled nodes
+ * may still be freed after the thread-local destructors have run (e.g. by
+ * static objects at exit). Such blocks go to the global list directly.
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <cstddef>
+#include <mutex>
+
+
+class MemPool{
+	// Blocks are multiples of ALIGN, larger sizes go to operator new.
+	static constexpr std::size_t ALIGN = 16;
+	static constexpr std::size_t MAX_SIZE = 512;
+	static constexpr std::size_t NUM_CLASS = MAX_SIZE / ALIGN;
+	static constexpr std::size_t CHUNK_SIZE = 64 * 1024;
+
+	struct Block{
+		Block* next;
+	};
+
+	struct FreeList{
+		Block* head[NUM_CLASS] = {};
+		// Whether the lists are handed to the global list (the thread exited).
+		bool released = false;
+	};
+
+	// Hands the free lists of the thread to the global list when it exits.
+	struct Releaser{
+		~Releaser();
+	};
+
+	// Leaked, so that it can still be used after the thread exits.
+	static thread_local FreeList* local;
+	static thread_local Releaser releaser;
+
+	// Free blocks of exited threads.
+	static std::mutex global_lock;
+	static Block* global[NUM_CLASS];
+
+	// Free lists of this thread, created on first use.
+	static FreeList& get_local();
+	// Refills the local free list of size class "cls".
+	static Block* refill(std::size_t cls);
+
+public:
+	MemPool() = delete;
+
+	static void* alloc(std::size_t size);
+	static void free(void* ptr, std::size_t size) noexcept;
+};
+
+template<typename T>
+class PoolAllocator{
+public:
+	typedef T value_type;
+
+	PoolAllocator() noexcept = default;
+	template<typename U>
+	PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+	T* allocate(std::size_t n){
+		return static_cast<T*>(MemPool::alloc(n * sizeof(T)));
+	}
+
+	void deallocate(T* ptr, std::size_t n) noexcept{
+		MemPool::free(ptr, n * sizeof(T));
+	}
+
+	template<typename U>
+	bool operator==(const PoolAllocator<U>&) const noexcept{
+		return true;
+	}
+
+	template<typename U>
+	bool operator!=(const PoolAllocator<U>&) const noexcept{
+		return false;
+	}
+};
+
+#endif // POOL_H
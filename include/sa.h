@@ -14,6 +14,7 @@
 #include "util.h"
 
 class Cluster;
+class LayerEngine;
 class LTreeNode;
 class SchNode;
 //#include "cluster.h"
@@ -48,10 +49,15 @@ class SAEngine{
 public:
 	// Total #rounds of SA.
 	static int nrounds;
+	// Layer engine used in the first fast_ratio*nrounds rounds (nullptr: not used).
+	// Schemes are re-searched with the global engine after these rounds.
+	static LayerEngine* fastMapper;
+	static double fast_ratio;
 
 private:
-	// SA has 7 OPs (OP1 in SET paper is divided into two OPs <- this can be optimized)
-	static constexpr int NUM_OP = 7;
+	// SA has 8 OPs (OP1 in SET paper is divided into two OPs <- this can be optimized)
+	// OP 7 switches the weights of a layer between pinned and streamed.
+	static constexpr int NUM_OP = 8;
 
 	// Halves all batch sizes under node.
 	static void halv_bat(LTreeNode* node);
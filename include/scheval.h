@@ -0,0 +1,171 @@
+/* This file contains
+ *	SchEval: Compact (structure-of-arrays) evaluator of an RA Tree scheme.
+ *
+ * SchEval flattens a SchNode tree into arrays indexed by node id, and
+ * re-aggregates cost, buffer usage and NoC bottom-up, with the same rules
+ * as TCut::construct() and SCut::construct() (TCut/SCut::add_child & finish,
+ * on a Row of the arrays). Only the results of LNodes (from the intra-layer
+ * search) are read from the tree.
+ *
+ * Node ids are assigned in post-order, so each node comes after all of its
+ * children, and the root is the last node. Cost and energy are scalar arrays,
+ * buffer usages are stored densely, with one entry for each core on the chip,
+ * and a NoC is only kept for the root and each segment.
+ */
+
+#ifndef SCHEVAL_H
+#define SCHEVAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "noc.h"
+#include "schnode.h"
+#include "util.h"
+
+
+class SchEval{
+public:
+	typedef std::uint32_t nid_t;
+	typedef SchNode::NodeType NodeType;
+	typedef SchNode::SchCost SchCost;
+
+	static constexpr nid_t NONE = static_cast<nid_t>(-1);
+
+	/*
+	 * Buffer usage of all cores, in a row of the dense usage arrays
+	 * (or in its own storage for temporary sums).
+	 * Has the operations of BufferUsage used by the TCut/SCut rules.
+	 */
+	class DenseUsage{
+		vol_t* data;
+		std::vector<vol_t> own;
+		cidx_t num_cores;
+		vol_t capacity;
+		bool valid;
+
+		bool fits() const;
+
+	public:
+		DenseUsage(vol_t* _data, cidx_t _num_cores, vol_t _capacity);
+		// Copies are temporaries with their own storage.
+		DenseUsage(const DenseUsage& other);
+		DenseUsage& operator=(const DenseUsage& other) = delete;
+
+		operator bool() const;
+		DenseUsage operator+(const DenseUsage& other) const;
+		DenseUsage& operator+=(const DenseUsage& other);
+		void max_with(const DenseUsage& other);
+		bool multiple(vol_t n);
+	};
+
+	// Results of one node, as references into the arrays (see TCut::add_child).
+	struct Row{
+		SchCost& cost;
+		energy_t& ubuf_energy;
+		energy_t& buf_energy;
+		energy_t& bus_energy;
+		energy_t& mac_energy;
+		DenseUsage ifm_usage, wgt_usage, buf_usage;
+	};
+
+private:
+	// Flags of each node.
+	enum : std::uint8_t{
+		IS_TOP = 1,
+		IS_SEG = 2,
+		WGT_SHIFT = 4,
+	};
+
+	nid_t num_nodes;
+	cidx_t num_cores;
+	vol_t capacity;
+
+	// Tree structure
+	std::vector<NodeType> type;
+	std::vector<std::uint8_t> flags;
+	std::vector<len_t> num_bgrp;
+	std::vector<lid_t> num_stage;
+	std::vector<cidx_t> cluster_size;
+	// Children of node i: child_list[child_begin[i], child_begin[i+1])
+	std::vector<nid_t> child_begin;
+	std::vector<nid_t> child_list;
+	// The corresponding LNode (nullptr for Cuts)
+	std::vector<const LNode*> lnodes;
+
+	// Aggregated results
+	std::vector<char> valid;
+	std::vector<SchCost> cost;
+	std::vector<energy_t> ubuf_energy, buf_energy, bus_energy, mac_energy;
+	std::vector<vol_t> max_buf;
+	// Usage of node i on core c: xxx_usage[i * num_cores + c]
+	std::vector<vol_t> ifm_usage, wgt_usage, buf_usage;
+	// NoC of the root and of each segment (index into seg_noc, or NONE)
+	std::vector<nid_t> noc_idx;
+	std::vector<NoC> seg_noc;
+
+	nid_t flatten(const SchNode* node, bool is_top, bool is_seg);
+	Row row(nid_t id);
+	void evalLNode(nid_t id);
+	bool evalTCut(nid_t id);
+	bool evalSCut(nid_t id);
+
+	// Adds the NoC of node "id" times "factor" into "noc".
+	void addNoC(nid_t id, len_t factor, NoC& noc) const;
+
+public:
+	explicit SchEval(const SchNode* root);
+
+	// Re-aggregates the whole tree, returns whether the scheme is valid.
+	bool eval();
+
+	nid_t size() const;
+	nid_t root() const;
+	NodeType get_type(nid_t id) const;
+	const LNode* get_lnode(nid_t id) const;
+	const nid_t* children_begin(nid_t id) const;
+	const nid_t* children_end(nid_t id) const;
+	// Whether node "id" is a segment, and its #bgrp (1 for LNodes).
+	bool is_seg(nid_t id) const;
+	len_t get_num_bgrp(nid_t id) const;
+	// Repeat times and segment index (-1 if none) of each node.
+	void number_nodes(std::vector<len_t>& repeat, std::vector<long>& segment) const;
+
+	// Results of node "id", only valid after eval().
+	bool is_valid(nid_t id) const;
+	SchCost get_cost(nid_t id) const;
+	energy_t get_ubuf_energy(nid_t id) const;
+	energy_t get_buf_energy(nid_t id) const;
+	energy_t get_bus_energy(nid_t id) const;
+	energy_t get_mac_energy(nid_t id) const;
+	vol_t get_max_buf(nid_t id) const;
+	// NoC of the root/a segment, nullptr for other nodes.
+	const NoC* get_noc(nid_t id) const;
+
+	/*
+	 * Prints a CSV with one row per LNode, one row per segment and
+	 * a final row for the whole scheme, only valid after eval().
+	 *
+	 * "repeat" is the number of times a node is executed (product of
+	 * #bgrp of its ancestors), a layer costs repeat*energy in total.
+	 * Energy & time of segments are already multiplied by their #bgrp.
+	 */
+	void print_breakdown(std::ostream& os) const;
+
+	/*
+	 * Prints a CSV of the load of each used link ("link") and DRAM port
+	 * ("dram", only with NoC::dram_port_bw) in each segment and in the
+	 * whole scheme, only valid after eval().
+	 *
+	 * Links are indexed by (x, y, dir) as in NoC. "cycles" is the time
+	 * to transfer "load" on the link/port, and "ratio" is cycles divided
+	 * by the time of the segment.
+	 */
+	void print_links(std::ostream& os) const;
+	// Prints the *top* links and DRAM ports with the most cycles of each segment.
+	void print_hotspots(std::ostream& os, std::size_t top = 10) const;
+};
+
+#endif // SCHEVAL_H
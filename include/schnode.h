@@ -12,6 +12,7 @@
 #ifndef SCHNODE_H
 #define SCHNODE_H
 
+#include <cstddef>
 #include <cstdint>
 #include <deque>
 #include <iostream>
@@ -27,9 +28,11 @@
 #include "ltreenode.h"
 #include "noc.h"
 #include "placement.h"
+#include "pool.h"
 #include "util.h"
 
 class LayerEngine;
+class SchEval;
 class StdLayerEngine;
 namespace Json {
 class Value;
@@ -40,18 +43,13 @@ class Value;
 class LNode;
 class Cut;
 
-class SchNode {
-public:
-  typedef SchNode *sn_ptr;
-  typedef const SchNode *csn_ptr;
-  typedef SchNode &sn_ref;
-  typedef std::deque<sn_ptr> sn_vec;
-
-  typedef Cut *cut_ptr;
-
-  typedef std::unordered_map<lid_t, LNode *> nodeList_t;
-  typedef LTreeNode::NodeType NodeType;
-
+/*
+ * Results of a node in the RA Tree: cost, NoC, buffer usages and energy.
+ * LNodes get them from the intra-layer search, and cuts aggregate them
+ * from their children with the rules in TCut/SCut (add_child & finish),
+ * which are shared by construct() and SchEval (on SchEval::Row).
+ */
+struct SchResult {
   // Cost, including energy and latency(time)
   struct SchCost {
     energy_t energy;
@@ -69,10 +67,59 @@ public:
     friend std::ostream &operator<<(std::ostream &os, const SchCost &cost);
   };
 
+  SchCost cost; // total cost of current node
+  NoC noc;      // noc information
+
+  // Occupied buffer size, see doc for more documentation.
+  BufferUsage buf_usage, ifm_usage, wgt_usage;
+  // Total energy of ubuf/buffer/bus/mac (in intra-core)
+  energy_t ubuf_energy, buf_energy, bus_energy, mac_energy;
+
+  // Resets to the results of an empty cut (zero cost and usage).
+  void reset();
+};
+
+class SchNode : protected SchResult {
+public:
+  typedef SchNode *sn_ptr;
+  typedef const SchNode *csn_ptr;
+  typedef SchNode &sn_ref;
+  typedef std::deque<sn_ptr, PoolAllocator<sn_ptr>> sn_vec;
+
+  typedef Cut *cut_ptr;
+
+  typedef std::unordered_map<lid_t, LNode *, std::hash<lid_t>,
+                             std::equal_to<lid_t>,
+                             PoolAllocator<std::pair<const lid_t, LNode *>>>
+      nodeList_t;
+  typedef LTreeNode::NodeType NodeType;
+
+  // State shared by all nodes during one incremental search.
+  // See Cut::searchInc() for more details.
+  struct IncState {
+    // lnodeList before the search, used to find reusable LNodes.
+    nodeList_t oldLNodes;
+    // Replaced nodes, only deleted when the whole search finishes.
+    sn_vec staleNodes;
+  };
+
+  typedef SchResult::SchCost SchCost;
+
   // The global layer engine.
   static LayerEngine *layerMapper;
+  // Layer engine of the current thread, overrides layerMapper if not nullptr.
+  // (Used by SA to search with a faster engine in some rounds)
+  static thread_local LayerEngine *threadMapper;
+  // Returns the layer engine used by the current thread.
+  static LayerEngine *get_mapper();
   // The total batch size.
   static len_t tot_batch;
+  /*
+   * Whether the NoC & DRAM time is bounded in each phase: in each LNode, and
+   * in each stage of an SCut (with the traffic of all children in the stage),
+   * besides the bound on the whole segment. See SCut::construct().
+   */
+  static bool phase_noc;
 
 protected:
   bool valid;              // whether scheme is valid
@@ -80,18 +127,17 @@ protected:
   const len_t num_batch;   // batch num (b_i in SET paper)
   const Cluster cluster;   // core cluster (TG_i in SET paper)
   const Cut *const parent; // parent of current node
-  SchCost cost;            // total cost of current node
-  NoC noc;                 // noc information
 
-  // Occupied buffer size, see doc for more documentation.
-  BufferUsage buf_usage, ifm_usage, wgt_usage;
-  // Total energy of ubuf/buffer/bus/mac (in intra-core)
-  energy_t ubuf_energy, buf_energy, bus_energy, mac_energy;
+  // cost, noc, buffer usages and energy are in SchResult.
 
   // lnodeList points to a list of all SchNodes on the tree.
   // All SchNodes on the tree shares one lnodeList, managed by the root.
   nodeList_t *const lnodeList;
 
+  // Points to the state of the current incremental search (nullptr if none).
+  // Only valid during construction, inherited from parent.
+  IncState *incState;
+
   SchNode(const SchNode &node) = default;
 
 public:
@@ -103,6 +149,12 @@ public:
   SchNode(NodeType t, const Cluster &_c, cut_ptr _parent, len_t nbatch);
   virtual ~SchNode() = 0;
 
+  // All SchNodes are allocated from MemPool.
+  static void *operator new(std::size_t size) { return MemPool::alloc(size); }
+  static void operator delete(void *ptr, std::size_t size) {
+    MemPool::free(ptr, size);
+  }
+
   // Used to set a new parent for this. See the implementation of copy().
   void setParent(Cut *newParent);
 
@@ -122,6 +174,7 @@ public:
 
   NodeType get_type() const;
   const Cluster &get_cluster() const;
+  len_t get_num_batch() const;
   SchCost get_cost() const;
   const NoC &get_noc() const;
   const BufferUsage &get_buf_usage() const;
@@ -131,6 +184,7 @@ public:
   energy_t get_buf_energy() const;
   energy_t get_bus_energy() const;
   energy_t get_mac_energy() const;
+  const SchResult &get_result() const;
 
   // Print functions.
   // Prints detailed scheme with all information.
@@ -140,7 +194,9 @@ public:
   virtual void print_tree(std::string pad = "",
                           std::ostream &os = std::cout) const = 0;
   // Prints only a energy & performance summary.
-  void print_summary(std::ostream &os = std::cout) const;
+  // For the root, also cross-checks its cost with *eval* (evaluated on this tree).
+  void print_summary(std::ostream &os = std::cout,
+                     const SchEval *eval = nullptr) const;
 
   friend std::ostream &operator<<(std::ostream &os, const SchNode &sch);
   friend std::ostream &operator<<(std::ostream &os, const SchNode *sch);
@@ -186,12 +242,19 @@ private:
   PlaceSch place_sch;    // Placement (and partition) scheme
   const Bitset dirp_set; // Direct prev layers (for shortcut)
   const bool to_dram;    // whether writes results to DRAM
+  const bool wgt_stream; // whether weights are re-fetched in each batch group
+  // Layer engine that searched this scheme (see SchNode::threadMapper)
+  const LayerEngine *engine;
   CoreMapper::CoreMapping
       tileSch; // scheduling scheme of this layer (tiling, etc.)
 
   // Search for intra-layer scheme
   bool search();
 
+  // Returns the old LNode (in incremental search) whose scheme can be
+  // reused by this LNode, or nullptr if any of its inputs changed.
+  const LNode *findReusable() const;
+
 public:
   LNode(LTreeNode *_node, const Cluster &_c, cut_ptr _parent);
   virtual ~LNode() override;
@@ -210,6 +273,8 @@ public:
   const PlaceSch &get_place_sch() const;
   const Bitset &get_dirp_set() const;
   bool get_to_dram() const;
+  bool get_wgt_stream() const;
+  const CoreMapper::CoreMapping &get_tile_sch() const;
 
   virtual void print_scheme(std::string pad = "",
                             std::ostream &os = std::cout) const override;
@@ -240,6 +305,13 @@ protected:
   // Iteratively construct all childs while updating *this
   virtual void construct(LTreeNode *node) = 0;
 
+  // Total min weights of the layers in *node* that are pinned (not streamed,
+  // and not from prev layers).
+  vol_t pinnedWgtVol(LTreeNode *node) const;
+  // Whether the weights pinned in this cut (of *node*) may fit in the buffer.
+  // (Fast pre-check before construct(), false means always overflow)
+  bool pinnedWgtFits(LTreeNode *node) const;
+
 public:
   Cut(NodeType t, LTreeNode *node, const Cluster &_c, cut_ptr _parent);
   virtual ~Cut() override;
@@ -283,6 +355,22 @@ public:
 
   virtual SchNode *copy(Cut *newParent = nullptr) const override;
 
+  /*
+   * Aggregation rules of cost, buffer usages and energy, shared by
+   * construct() (on SchResult) and SchEval (on SchEval::Row).
+   * *res* starts from zero, add_child() adds each child (*last* is the
+   * previous child, nullptr for the first one), and finish() checks the
+   * buffer and multiplies all by #bgrp.
+   * Both return false if the buffer overflows.
+   * The NoC (and the NoC bound of segments) is added by the caller.
+   */
+  template <typename Res>
+  static bool add_child(Res &res, const Res &child, const Res *last,
+                        bool is_top, bool is_seg, bool wgt_shift);
+  template <typename Res>
+  static bool finish(Res &res, const Res &first, const Res &last,
+                     len_t num_bgrp, bool is_top, bool is_seg, bool wgt_shift);
+
 #ifndef NOT_GEN_IR
   // **************** Code for IR generation ****************
   virtual void
@@ -304,6 +392,26 @@ public:
 
   virtual SchNode *copy(Cut *newParent = nullptr) const override;
 
+  lid_t get_num_stage() const;
+
+  /*
+   * Time of each stage, from the max time of all children, and with
+   * phase_noc, the NoC of all children (in one batch group).
+   */
+  static cycle_t stage_time(cycle_t max_time, const NoC &noc);
+
+  /*
+   * Aggregation rules, shared by construct() and SchEval (see TCut).
+   * *max_time* is the max time of the children added so far, and
+   * *stage* is the time of each stage (see stage_time).
+   */
+  template <typename Res>
+  static bool add_child(Res &res, const Res &child, cycle_t &max_time,
+                        len_t num_bgrp, bool is_seg);
+  template <typename Res>
+  static bool finish(Res &res, cycle_t stage, lid_t num_stage,
+                     len_t num_bgrp, bool is_seg);
+
 #ifndef NOT_GEN_IR
   // **************** Code for IR generation ****************
   virtual void
@@ -0,0 +1,69 @@
+/* This file contains
+ *	ThreadPool: Fixed-size pool of worker threads for parallel loops.
+ *
+ * run(n, func) calls func(0), ..., func(n-1) on the workers and on the
+ * calling thread, and returns when all calls are finished.
+ *
+ * Several threads (e.g. different SA chains) may call run() at the same time.
+ * Since the calling thread also works on its own job, run() always makes
+ * progress even if all workers are busy.
+ */
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+class ThreadPool{
+public:
+	typedef std::function<void(std::size_t)> task_func;
+
+private:
+	struct Job{
+		const task_func& func;
+		const std::size_t num;
+		// Index of the next task to run.
+		std::atomic<std::size_t> next;
+		// #tasks finished and #workers on this job (protected by lock).
+		std::size_t done, users;
+
+		Job(const task_func& _func, std::size_t _num);
+	};
+
+	std::vector<std::thread> workers;
+	// Jobs with tasks not started yet.
+	std::deque<Job*> jobs;
+	std::mutex lock;
+	std::condition_variable job_cv, done_cv;
+	bool stopping;
+
+	// Main loop of workers.
+	void work();
+	// Runs tasks of "job" until all are started, returns #tasks run.
+	static std::size_t runTasks(Job& job);
+	// Removes "job" from jobs (with lock held).
+	void removeJob(Job* job);
+
+public:
+	// The pool has "num_workers" threads besides the calling thread.
+	explicit ThreadPool(std::size_t num_workers);
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+	~ThreadPool();
+
+	// Runs func(0) ... func(num-1), returns when all of them finish.
+	void run(std::size_t num, const task_func& func);
+
+	// Number of threads that may run tasks of one job (including the caller).
+	std::size_t size() const;
+};
+
+#endif // THREADPOOL_H
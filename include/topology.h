@@ -0,0 +1,86 @@
+/* This file contains
+ *	Topology: Links of the NoC between cores (and DRAM ports).
+ *
+ * The NoC is a mesh of Cluster::xlen * Cluster::ylen cores, and each core
+ * has links to direction ESWN (0123). The mesh can be changed with:
+ *
+ *   torus:   Wrap-around links in each row and column, e.g. the E link of
+ *            (xlen-1, y) goes to (0, y). Each dimension is routed in the
+ *            shorter direction.
+ *   express: Express links of length *express* in each row and column,
+ *            between cores at multiples of *express* (link directions
+ *            4567 = ESWN). Unicasts take them in the middle of straight
+ *            paths, each express link is one hop.
+ *   chiplet: Cores are grouped into chiplets of chiplet_x * chiplet_y cores.
+ *            Links between two chiplets (D2D links) have bandwidth d2d_bw,
+ *            and one hop on them costs d2d_cost times of a normal hop.
+ *
+ * The routing itself is in NoC (unicastCalc / multicastCalc).
+ */
+
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <cstdint>
+#include <vector>
+
+#include "util.h"
+
+
+class Topology{
+	// d2d[link_idx]: whether the link is a D2D link (see link_idx)
+	static std::vector<bool> d2d;
+	// Cached results of is_mesh() and has_d2d(), set in init().
+	static bool mesh, hasD2D;
+
+public:
+	static bool torus;
+	static mlen_t express;
+	// 0 means the whole mesh is one chiplet.
+	static mlen_t chiplet_x, chiplet_y;
+	static bw_t d2d_bw;
+	static double d2d_cost;
+
+	// Checks all parameters and sets D2D links, called after Cluster::xlen/ylen are set.
+	static void init();
+
+	// Whether the NoC is a plain mesh (no torus/express/chiplets).
+	static bool is_mesh();
+	// Whether there are D2D links.
+	static bool has_d2d();
+
+	// Number of link directions of each core (4, or 8 with express links).
+	static mlen_t num_dirs();
+	// Number of link indices, num_dirs() * xlen * ylen.
+	static std::int32_t num_links();
+	// Index of the link from (x, y) to direction dir, in [0, num_links()).
+	static std::int32_t link_idx(mlen_t x, mlen_t y, mlen_t dir);
+	// Inverse of link_idx.
+	static void link_pos(std::int32_t link_idx, mlen_t& x, mlen_t& y, mlen_t& dir);
+
+	// Whether the link *link_idx* is a D2D link.
+	static bool is_d2d(std::int32_t link_idx);
+
+	// The core at the other end of the link from (x, y) to direction dir.
+	static pos_t link_to(mlen_t x, mlen_t y, mlen_t dir);
+
+	// Shortest signed offset from a to b in a dimension of *len* cores.
+	static int offset(mlen_t a, mlen_t b, mlen_t len);
+	// #hops of the unicast route from a to b.
+	static int distance(pos_t a, pos_t b);
+
+	/*
+	 * Whether a straight path between positions a < b (without wrap-around)
+	 * takes express links, which are from e0 to e1 (both multiples of express).
+	 */
+	static bool express_span(int a, int b, int& e0, int& e1);
+
+	/*
+	 * #D2D links among the local links at [from, to] in a dimension of *len*
+	 * cores, going forward (E/S) if *fwd*, otherwise backward (W/N).
+	 * *chip* is the chiplet size in this dimension.
+	 */
+	static int count_d2d(int from, int to, bool fwd, mlen_t len, mlen_t chip);
+};
+
+#endif // TOPOLOGY_H
@@ -91,6 +91,8 @@ extern cost_t calc_cost(energy_t energy, cycle_t time);
 
 // part_intv guarantees that the first element is always non-zero.
 extern len_t* part_intv(len_t tot_len, len_t ncuts);
+// Same as above, but writes the ncuts+1 boundaries into *arr*.
+extern void part_intv(len_t tot_len, len_t ncuts, len_t* arr);
 
 struct pos_t{
 	typedef std::uint16_t pos_hash_t;
@@ -3,9 +3,12 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstdio>
 #include <iomanip>
 #include <iostream>
 #include <map>
+#include <sstream>
+#include <stdexcept>
 
 #include "cluster.h"
 #include "layer.h"
@@ -141,6 +144,110 @@ void FullTrace::print(std::ostream &os) const {
   }
 }
 
+// Splits "a | b | c" into trimmed fields.
+static std::vector<std::string> split_fields(const std::string &line) {
+  std::vector<std::string> fields;
+  std::istringstream ss(line);
+  std::string field;
+  while (std::getline(ss, field, '|')) {
+    auto first = field.find_first_not_of(" \t");
+    auto last = field.find_last_not_of(" \t\r");
+    fields.push_back(first == std::string::npos
+                         ? ""
+                         : field.substr(first, last - first + 1));
+  }
+  return fields;
+}
+
+void FullTrace::read(std::istream &is) {
+  mesh_x = mesh_y = 0;
+  network_name.clear();
+  total_batch = 0;
+  chiplet_traces.clear();
+
+  bool in_ops = false;
+  std::string line;
+  while (std::getline(is, line)) {
+    if (line.empty() || line == "\r")
+      continue;
+    int x, y, id;
+    unsigned long batch;
+    char name[256];
+    if (std::sscanf(line.c_str(), "# Mesh: %dx%d", &x, &y) == 2) {
+      mesh_x = static_cast<mlen_t>(x);
+      mesh_y = static_cast<mlen_t>(y);
+    } else if (std::sscanf(line.c_str(), "# Network: %255s", name) == 1) {
+      network_name = name;
+    } else if (std::sscanf(line.c_str(), "# Total Batch: %lu", &batch) == 1) {
+      total_batch = static_cast<len_t>(batch);
+    } else if (std::sscanf(line.c_str(), "===== CHIPLET %d (%d,%d)", &id, &x,
+                           &y) == 3) {
+      SingleChipletTrace trace;
+      trace.chiplet_id = id;
+      trace.pos_x = static_cast<mlen_t>(x);
+      trace.pos_y = static_cast<mlen_t>(y);
+      chiplet_traces.push_back(trace);
+      in_ops = false;
+    } else if (line[0] == '[') {
+      in_ops = (line.compare(0, 20, "[ORDERED_OPERATIONS]") == 0);
+    } else if (in_ops && line[0] != '#') {
+      if (chiplet_traces.empty()) {
+        throw std::invalid_argument("Invalid trace: operations before any "
+                                    "chiplet: " + line);
+      }
+      auto fields = split_fields(line);
+      if (fields.size() != 6 || fields[5].empty() || fields[5][0] != 'T') {
+        throw std::invalid_argument("Invalid trace operation: " + line);
+      }
+      Operation op;
+      if (fields[1] == "RECV") {
+        op.type = OpType::RECV;
+      } else if (fields[1] == "SEND") {
+        op.type = OpType::SEND;
+      } else if (fields[1] == "COMPUTE") {
+        op.type = OpType::COMPUTE;
+      } else {
+        throw std::invalid_argument("Invalid trace operation: " + line);
+      }
+      if (fields[2] == "DRAM") {
+        op.peer_id = -1;
+      } else if (fields[2] == "-") {
+        op.peer_id = -2;
+      } else {
+        op.peer_id = std::stoi(fields[2]);
+      }
+      op.layer_name = fields[3];
+      op.data_size = static_cast<vol_t>(std::stoull(fields[4]));
+      op.transfer_id = std::stoi(fields[5].substr(1));
+      chiplet_traces.back().operations.push_back(op);
+    }
+  }
+
+  if (mesh_x == 0 || mesh_y == 0 || chiplet_traces.empty()) {
+    throw std::invalid_argument("Invalid trace: no mesh or chiplets!");
+  }
+  for (size_t i = 0; i < chiplet_traces.size(); i++) {
+    const auto &trace = chiplet_traces[i];
+    if (trace.chiplet_id != static_cast<int>(i) || trace.pos_x >= mesh_x ||
+        trace.pos_y >= mesh_y) {
+      throw std::invalid_argument("Invalid trace: chiplet " +
+                                  std::to_string(trace.chiplet_id) +
+                                  " is out of order or out of the mesh!");
+    }
+    for (const auto &op : trace.operations) {
+      // SEND goes to a chiplet, others may also use DRAM (-1) or none (-2).
+      const int min_peer = (op.type == OpType::SEND) ? 0 : -2;
+      if (op.peer_id < min_peer ||
+          op.peer_id >= static_cast<int>(chiplet_traces.size())) {
+        throw std::invalid_argument(
+            "Invalid trace: chiplet " + std::to_string(trace.chiplet_id) +
+            " has an operation with invalid peer " +
+            std::to_string(op.peer_id) + "!");
+      }
+    }
+  }
+}
+
 // ============== TraceGenerator Implementation ==============
 
 TraceGenerator::TraceGenerator(const SchNode *root, mlen_t xlen, mlen_t ylen)
@@ -4,6 +4,7 @@
 #include <cstring>
 
 #include "bufferusage.h"
+#include "noc.h"
 
 
 void DataLayout::update(const fmap_range& range){
@@ -74,6 +75,7 @@ DataLayout::Entry UniqueLayout::at(dataLen_t idx) const{
 
 StdDataLayout::StdDataLayout(dataLen_t _len, pos_t* _posArr)
 	:range_len(_len), bcast_len(1), tot_len(_len),
+	 rangeArr((_len>0) ? std::make_unique<fmap_range[]>(_len) : nullptr),
 	 contPosArr((_len>0) ? std::make_unique<pos_t[]>(_len) : nullptr),
 	 posArr(_posArr){}
 
@@ -91,7 +93,6 @@ DataLayout* StdDataLayout::clone() const{
 	newLayout->bcast_down = bcast_down;
 	newLayout->bcast_step = bcast_step;
 
-	newLayout->rangeArr = std::make_unique<fmap_range[]>(range_len);
 	newLayout->posArr = newLayout->contPosArr.get();
 	memcpy(newLayout->rangeArr.get(), rangeArr.get(), sizeof(rangeArr[0]) * range_len);
 	memcpy(newLayout->posArr, posArr, sizeof(posArr[0]) * tot_len);
@@ -160,7 +161,6 @@ void StdDataLayout::setBcast(dataLen_t _bcastLen, dataLen_t _bcastStep){
 	bcast_down = _bcastStep * _bcastLen;
 
 	range_len = tot_len / bcast_len;
-	rangeArr.reset(new fmap_range[range_len]);
 	clear();
 }
 
@@ -246,19 +246,27 @@ StdULayout::IntersectIter StdULayout::get_intersect(const fmap_range& range, boo
 	return IntersectIter(from, to, *this);
 }
 
-/*
-MemULayout::MemULayout(const fmap_range& _range, pos_t* _posArr, len_t memLen)
-	:UniqueLayout(memLen), range(_range), posArr(_posArr){}
+MemULayout::MemULayout(const StdULayout& _ofmLayout)
+	:UniqueLayout(_ofmLayout.totLength()), ofmLayout(_ofmLayout){}
+
+UniqueLayout* MemULayout::clone() const{
+	return new MemULayout(*this);
+}
+
+void MemULayout::finalize(){}
 
 void MemULayout::reset(){
 	len = 0;
-	posArr = nullptr;
 }
 
 DataLayout::UniqueEntry MemULayout::operator[](dataLen_t idx) const{
-	return {range, posArr[idx], len};
+	UniqueEntry entry = ofmLayout[idx];
+	return {entry.range, NoC::nearest_dram(entry.tile)};
+}
+
+const StdULayout& MemULayout::getOfmL() const{
+	return ofmLayout;
 }
-*/
 
 UniqueLayout::Iterator::Iterator(const UniqueLayout& _layout, dataLen_t _i)
 	:i(_i), layout(_layout){}
@@ -0,0 +1,184 @@
+#include "layerdb.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define LAYERDB_MMAP
+#endif
+
+
+LayerDB layerDB;
+
+struct LayerDB::Header{
+	char magic[8];
+	std::uint32_t version, slotSize;
+	std::uint64_t capacity, count;
+};
+
+struct LayerDB::Slot{
+	// key == 0 means an empty slot.
+	hash_t key, check;
+	Record rec;
+};
+
+static constexpr char DB_MAGIC[8] = "SETLDB";
+static constexpr LayerDB::hash_t FNV_PRIME = 0x100000001b3ULL;
+
+LayerDB::Hasher::Hasher(hash_t seed)
+	:h1(0xcbf29ce484222325ULL ^ seed), h2(0x84222325cbf29ce4ULL ^ (seed * FNV_PRIME)){}
+
+void LayerDB::Hasher::addByte(std::uint8_t byte){
+	h1 = (h1 ^ byte) * FNV_PRIME;
+	h2 = (h2 ^ (byte + 0x5bu)) * FNV_PRIME;
+}
+
+LayerDB::Hasher& LayerDB::Hasher::add(const std::string& str){
+	add(str.size());
+	for(char c: str) addByte(static_cast<std::uint8_t>(c));
+	return *this;
+}
+
+LayerDB::Key LayerDB::Hasher::get() const{
+	// 0 is reserved for empty slots.
+	return {(h1 == 0) ? 1 : h1, h2};
+}
+
+LayerDB::LayerDB()
+	:header(nullptr), slots(nullptr), mapSize(0), fd(-1), config(0),
+	  numHits(0), numMisses(0), numDropped(0){}
+
+LayerDB::~LayerDB(){
+	close();
+}
+
+void LayerDB::open(const std::string& path, hash_t config_hash, std::size_t capacity){
+	close();
+	config = config_hash;
+#ifdef LAYERDB_MMAP
+	fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if(fd < 0){
+		throw std::invalid_argument("Cannot open layer database \"" + path + "\"!");
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) != 0){
+		close();
+		throw std::invalid_argument("Cannot stat layer database \"" + path + "\"!");
+	}
+
+	// Reuse the capacity of an existing file.
+	Header old;
+	bool reuse = false;
+	if(static_cast<std::size_t>(st.st_size) >= sizeof(Header) && pread(fd, &old, sizeof(Header), 0) == sizeof(Header)){
+		reuse = std::memcmp(old.magic, DB_MAGIC, sizeof(DB_MAGIC)) == 0
+				&& old.version == VERSION && old.slotSize == sizeof(Slot) && old.capacity > 0
+				&& static_cast<std::size_t>(st.st_size) == sizeof(Header) + old.capacity * sizeof(Slot);
+	}
+	if(reuse) capacity = old.capacity;
+
+	mapSize = sizeof(Header) + capacity * sizeof(Slot);
+	if(!reuse){
+		// Clears the file (unused slots are zero).
+		if(ftruncate(fd, 0) != 0 || ftruncate(fd, static_cast<off_t>(mapSize)) != 0){
+			close();
+			throw std::invalid_argument("Cannot resize layer database \"" + path + "\"!");
+		}
+	}
+
+	void* ptr = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(ptr == MAP_FAILED){
+		close();
+		throw std::invalid_argument("Cannot map layer database \"" + path + "\"!");
+	}
+	header = static_cast<Header*>(ptr);
+	slots = reinterpret_cast<Slot*>(static_cast<char*>(ptr) + sizeof(Header));
+
+	if(!reuse){
+		std::memcpy(header->magic, DB_MAGIC, sizeof(DB_MAGIC));
+		header->version = VERSION;
+		header->slotSize = sizeof(Slot);
+		header->capacity = capacity;
+		header->count = 0;
+	}
+#else
+	(void) path;
+	(void) capacity;
+	throw std::invalid_argument("Layer database is not supported on this platform!");
+#endif
+}
+
+void LayerDB::close(){
+#ifdef LAYERDB_MMAP
+	if(header != nullptr){
+		msync(header, mapSize, MS_SYNC);
+		munmap(header, mapSize);
+	}
+	if(fd >= 0) ::close(fd);
+#endif
+	header = nullptr;
+	slots = nullptr;
+	mapSize = 0;
+	fd = -1;
+}
+
+bool LayerDB::is_open() const{
+	return header != nullptr;
+}
+
+LayerDB::Hasher LayerDB::hasher() const{
+	return Hasher(config);
+}
+
+LayerDB::Slot* LayerDB::findSlot(const Key& key) const{
+	const std::uint64_t cap = header->capacity;
+	std::uint64_t i = key.key % cap;
+	// Linear probing, the table is never full (see insert).
+	while(slots[i].key != 0){
+		if(slots[i].key == key.key && slots[i].check == key.check) break;
+		if(++i == cap) i = 0;
+	}
+	return slots + i;
+}
+
+bool LayerDB::find(const Key& key, Record& rec){
+	std::lock_guard<std::mutex> guard(lock);
+	const Slot* s = findSlot(key);
+	if(s->key == 0){
+		++numMisses;
+		return false;
+	}
+	rec = s->rec;
+	++numHits;
+	return true;
+}
+
+void LayerDB::insert(const Key& key, const Record& rec){
+	std::lock_guard<std::mutex> guard(lock);
+	Slot* s = findSlot(key);
+	if(s->key != 0){
+		s->rec = rec;
+		return;
+	}
+	if((header->count + 1) * 4 > header->capacity * 3){
+		++numDropped;
+		return;
+	}
+	s->check = key.check;
+	s->rec = rec;
+	s->key = key.key;
+	++header->count;
+}
+
+void LayerDB::print_stats(std::ostream& os) const{
+	if(!is_open()) return;
+	std::uint64_t hits = numHits;
+	os << "Layer DB: " << hits << " hits, " << numMisses << " misses, ";
+	os << header->count << '/' << header->capacity << " entries";
+	if(numDropped > 0) os << ", " << numDropped << " dropped (full)";
+	os << std::endl;
+}
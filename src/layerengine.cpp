@@ -1,21 +1,45 @@
 #include "layerengine.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
 
+#include "layerdb.h"
+#include "layertable.h"
 #include "network.h"
 #include "partition.h"
+#include "topology.h"
 
 
 bool LayerScheme::isValid() const{
 	return totCost.isValid();
 }
 
-StdLayerEngine::StdLayerEngine(CoreMapper* _mapper):mapper(_mapper){}
+StdLayerEngine::StdLayerEngine(CoreMapper* _mapper, std::size_t num_threads)
+	:StdLayerEngine(_mapper, num_threads, 0){}
+
+StdLayerEngine::StdLayerEngine(CoreMapper* _mapper, std::size_t num_threads, std::size_t _top_k)
+	:mapper(_mapper), pool((num_threads > 1) ? new ThreadPool(num_threads - 1) : nullptr), top_k(_top_k){}
+
+void StdLayerEngine::rankParts(LNode* curNode, std::vector<PartSch>& parts) const{
+	(void) curNode;
+	(void) parts;
+}
 
 vol_t StdLayerEngine::get_ubuf_size() const{
 	return mapper->get_ubuf_size();
 }
 
+void StdLayerEngine::print_stats(std::ostream& os) const{
+	std::uint64_t numParts = stats.numParts;
+	os << "Partitions evaluated: " << numParts;
+	os << ", pruned by lower bound: " << stats.numPruned;
+	os << ", placement loops cut: " << stats.numCut << std::endl;
+}
+
 /**
  * @brief StdLayerEngine::search.
  * Searches partition and placement of each layer.
@@ -24,13 +48,19 @@ vol_t StdLayerEngine::get_ubuf_size() const{
  *      estimate max ubuf usage
  *      search for intra-tile dataflow
  *      calculate ubuf energy (outside tile)
+ *      skip partition if its lower bound can't beat the best scheme
  *      for each placement:
- *		    calculate NoC
+ *		    calculate NoC (replay transfers of the first placement)
  *          update best scheme
+ *          stop if the lower bound can't beat the best scheme
+ *
+ * The ubuf energy, intra-tile cost (MAC time, etc.) and DRAM access
+ * don't depend on the placement, so they give a lower bound of the
+ * partition (DRAM access is only known after the first placement).
  *
  * @return LayerScheme.
  */
-LayerScheme StdLayerEngine::search(LNode* curNode) const{
+LayerScheme StdLayerEngine::searchScheme(LNode* curNode) const{
 	// The final scheme
 	LayerScheme layerSch;
 
@@ -40,136 +70,515 @@ LayerScheme StdLayerEngine::search(LNode* curNode) const{
 	const Cluster& cluster = curNode->cluster;
 	const Node& layerT = curNode->layert;
 	const Layer& layer = layerT.layer();
-	const fmap_shape& ofmShape = layer.ofmap_shape();
-	const len_t totBatch = LNode::tot_batch;
 	const len_t B = curNode->num_batch;
-	const bool wgt_B = layerT.hasWgtPrevs();
 
 	const cidx_t numCores = cluster.num_cores();
 	const Core::Buffer& ubuf = mapper->core().ubuf();
 	const vol_t totUbufSize = ubuf.Size * numCores;
 
+	// Static infos of this layer, precomputed at startup (if in the table).
+	const LayerTable::Entry* info = layerTable.get(curNode->layerid, numCores, B);
+
+	// Lower bound of "estimatedBuf" below for any partition,
+	// since there are at most numCores distinct ifmap/weight ranges.
+	if(info != nullptr){
+		if(!info->fits) return layerSch;
+	}else{
+		vol_t minBuf = ofm_ubuf_vol;
+		minBuf += DIVCEIL(layerT.get_min_ifm_vol(B), static_cast<vol_t>(numCores));
+		minBuf += DIVCEIL(layerT.get_min_wgt_vol(B), static_cast<vol_t>(numCores));
+		if(minBuf > ubuf.Size) return layerSch;
+	}
+
 	/* ########## Current scheme ########## */
 
-	SchNode::SchCost curCost;
-	CoreMapper::CoreMapping tileSch;
-	// Bandwidth is only calculated in the final scheme (Sec. Update optimal scheme)
-	NoC noc(false);
+	const bool hasWgt = layer.weight_size() > 0;
+	PlaceSch& placeSch = scratchPlaceSch(numCores, hasWgt);
 
-	PlaceSch placeSch;
-	{
-		pos_t* permOrder = new pos_t[numCores];
-		placeSch.permuteOrder.reset(permOrder);
-		placeSch.ifmLayout = std::make_unique<StdDataLayout>(numCores, permOrder);
-		if(layer.weight_size() > 0)
-			placeSch.wgtLayout = std::make_unique<StdDataLayout>(numCores, permOrder);
-		else
-			placeSch.wgtLayout = std::make_unique<StdDataLayout>(0, nullptr);
-		placeSch.ofmLayout = std::make_unique<StdULayout>(numCores, permOrder);
-		// permOrder = nullptr; // Handled to placeSch.permuteOrder
+	/* ########## Search iterations ########## */
+
+	// All valid partitions (the buffer is kept for later searches).
+	static thread_local std::vector<PartSch> parts;
+	parts.clear();
+	if(info != nullptr){
+		layerTable.get_parts(*info, numCores, parts);
+	}else{
+		// Minimal cuts on ifmap. Ifmap tile should not use too much ubuf.
+		len_t minCuts = 0;
+		if(REF_IS_INSTANCE(layer, ConvLayer) && !REF_IS_INSTANCE(layer, GroupConvLayer))
+			minCuts = static_cast<len_t>(layer.real_ifmap_shape().tot_size(B) / (totUbufSize*0.8) + 1);
+
+		// Iterator over all valid partitions.
+		PartSch partSch;
+		auto partIter = partEngine.init(numCores, B, layerT, partSch, minCuts);
+		if(partIter){
+			do{
+				parts.push_back(partSch);
+			}while(partIter.nextPart());
+		}
+	}
+	if(parts.empty()){
+		// No partition found!
+		return layerSch;
+	}
+
+	PruneCnt cnt;
+	const std::size_t numParts = parts.size();
+	if(top_k > 0 && numParts > top_k){
+		// Search the top_k partitions, and the rest only if none of them is valid.
+		rankParts(curNode, parts);
+		searchParts(curNode, parts.data(), top_k, layerSch, cnt);
+		if(!layerSch.isValid()) searchParts(curNode, parts.data() + top_k, numParts - top_k, layerSch, cnt);
+	}else if(pool){
+		searchParts(curNode, parts.data(), numParts, layerSch, cnt);
+	}else{
+		// Iter all partitions.
+		for(const auto& part: parts){
+			placeSch.part = part;
+			searchPart(curNode, placeSch, layerSch, cnt);
+		}
 	}
 
-	PartSch& partSch = placeSch.part;
+	stats.numParts += cnt.numParts;
+	stats.numPruned += cnt.numPruned;
+	stats.numCut += cnt.numCut;
 
-	/* ########## Search iterations ########## */
+	/* ########## Update optimal scheme ########## */
 
-	// For ubuf energy
-	const energy_t ubufOfm = ofmShape.tot_size(B) * ubuf.RCost;
-	energy_t ubufTotal;
+	if(layerSch.isValid()){
+		initScheme(curNode, layerSch);
+	}
 
-	// Minimal cuts on ifmap. Ifmap tile should not use too much ubuf.
-	len_t minCuts = 0;
-	if(REF_IS_INSTANCE(layer, ConvLayer) && !REF_IS_INSTANCE(layer, GroupConvLayer))
-		minCuts = static_cast<len_t>(layer.real_ifmap_shape().tot_size(B) / (totUbufSize*0.8) + 1);
+	return layerSch;
+}
 
-	// Iterator over all valid partitions.
-	auto partIter = partEngine.init(numCores, B, layerT, partSch, minCuts);
-	if(!partIter){
-		// No partition found!
+void StdLayerEngine::initScheme(LNode* curNode, LayerScheme& layerSch) const{
+	const Node& layerT = curNode->layert;
+
+	// The scratch buffers are kept for later searches
+	initPlaceSch(layerSch.place, curNode->cluster.num_cores(), layerT.layer().weight_size() > 0);
+
+	/* ##### Re-calculate placement scheme & NoC ##### */
+
+	// Init partition
+	initLayouts(layerSch.place, layerT, layerT.layer().ofmap_shape(), curNode->num_batch);
+
+	// Init placement
+	PlaceSch& place = layerSch.place;
+	if(place.gen == PlaceGen::ALIGN){
+		// The aligned placement is derived from the traffic of the default one.
+		place.gen = PlaceGen::ORDER;
+		place.initPlacement(curNode->cluster);
+		NoC::Traffic traffic;
+		NoC noc(false);
+		noc.record(&traffic);
+		calcNoC(noc, place, curNode);
+		noc.record(nullptr);
+
+		place.gen = PlaceGen::ALIGN;
+		pos_t alignPos[MAX_CHIPS];
+		bool aligned = alignPlacement(place, traffic, curNode->cluster, alignPos);
+		assert(aligned);
+		(void) aligned;
+		place.initPlacement(curNode->cluster, alignPos);
+	}else{
+		place.initPlacement(curNode->cluster);
+	}
+
+	// Finalize layerSch.place
+	layerSch.place.finalize();
+
+	// Update NoC, with the routing of the smallest max link.
+	NoC& noc = layerSch.noc;
+	int first = 0;
+	while((NoC::routing_mask & (1 << first)) == 0) ++first;
+	noc.set_routing(static_cast<NoC::Routing>(first));
+	if((NoC::routing_mask >> (first + 1)) == 0){
+		calcNoC(noc, layerSch.place, curNode);
+		return;
+	}
+
+	NoC::Traffic traffic;
+	noc.record(&traffic);
+	calcNoC(noc, layerSch.place, curNode);
+	noc.record(nullptr);
+	NoC cur = noc;
+	for(int r = first + 1; r < static_cast<int>(NoC::Routing::NUM); ++r){
+		if((NoC::routing_mask & (1 << r)) == 0) continue;
+		cur.set_routing(static_cast<NoC::Routing>(r));
+		cur.replay(traffic);
+		if(cur.get_max_link() < noc.get_max_link()) noc = cur;
+	}
+}
+
+/*
+ * With layerDB, the scheme is loaded from the database if the same
+ * search is done before (in this run or an earlier one). Otherwise
+ * it is searched and stored into the database.
+ */
+LayerScheme StdLayerEngine::search(LNode* curNode) const{
+	if(!layerDB.is_open()) return searchScheme(curNode);
+
+	const LayerDB::Key key = dbKey(curNode);
+	LayerDB::Record rec;
+	if(layerDB.find(key, rec)){
+		LayerScheme layerSch;
+		if(rec.valid){
+			const Node& layerT = curNode->layert;
+			layerSch.totCost = SchNode::SchCost(rec.energy, rec.time);
+			layerSch.extUbufEnergy = rec.extUbufEnergy;
+			layerSch.tileSch = mapper->genLayerMap(layerT.layer(), rec.part, curNode->num_batch, layerT.hasWgtPrevs());
+			layerSch.place.part = rec.part;
+			std::copy_n(rec.order, 4, layerSch.place.order);
+			layerSch.place.gen = static_cast<PlaceGen>(rec.gen);
+			initScheme(curNode, layerSch);
+		}
 		return layerSch;
 	}
 
-	// Iter all partitions.
+	LayerScheme layerSch = searchScheme(curNode);
+	rec.valid = layerSch.isValid();
+	if(rec.valid){
+		rec.part = layerSch.place.part;
+		std::copy_n(layerSch.place.order, 4, rec.order);
+		rec.gen = static_cast<std::uint8_t>(layerSch.place.gen);
+		rec.energy = layerSch.totCost.energy;
+		rec.time = layerSch.totCost.time;
+		rec.extUbufEnergy = layerSch.extUbufEnergy;
+	}else{
+		rec.part = PartSch(0, 0, 0, 0);
+		std::fill_n(rec.order, 4, 0);
+		rec.gen = 0;
+		rec.energy = rec.extUbufEnergy = 0;
+		rec.time = 0;
+	}
+	layerDB.insert(key, rec);
+	return layerSch;
+}
+
+/*
+ * The key covers all inputs of searchScheme() besides the global config:
+ * the layer engine, the layer, cluster, batch, to_dram, wgt_stream
+ * and the schemes of prevs whose layouts are used in calcNoC()
+ * (with the core of each tile for ALIGN, see PlaceSch::sameScheme).
+ */
+LayerDB::Key StdLayerEngine::dbKey(const LNode* curNode) const{
+	const Node& layerT = curNode->layert;
+	const Layer& layer = layerT.layer();
+	const Cluster& cluster = curNode->cluster;
+
+	auto h = layerDB.hasher();
+	h.add(top_k);
+
+	h.add(curNode->layerid).add(layerT.name());
+	for(const fmap_shape* shape: {&layer.tot_ifmap_shape(), &layer.real_ifmap_shape(), &layer.ofmap_shape()}){
+		h.add(shape->c).add(shape->h).add(shape->w);
+	}
+	h.add(layer.weight_size());
+
+	const pos_t first = cluster[0];
+	h.add(cluster.num_cores()).add(first.x).add(first.y);
+	h.add(curNode->num_batch).add(LNode::tot_batch);
+	h.add(curNode->to_dram).add(curNode->wgt_stream);
+
+	const Bitset& prevs = NoC::dram_layout ? layerT.getPrevs() : curNode->dirp_set;
+	FOR_BITSET(prev, prevs){
+		h.add(prev).add(curNode->dirp_set.contains(prev));
+		auto it = curNode->lnodeList->find(prev);
+		const LNode* prevNode = (it == curNode->lnodeList->end()) ? nullptr : it->second;
+		h.add(prevNode != nullptr);
+		if(prevNode == nullptr) continue;
+		const pos_t prevFirst = prevNode->cluster[0];
+		h.add(prevNode->cluster.num_cores()).add(prevFirst.x).add(prevFirst.y);
+		h.add(prevNode->num_batch);
+		const PlaceSch& place = prevNode->place_sch;
+		h.add(place.part.K).add(place.part.B).add(place.part.H).add(place.part.W);
+		for(std::uint8_t o: place.order) h.add(o);
+		h.add(place.gen);
+		// ALIGN depends on the placement of prevs of the prev, adds the core of each tile.
+		if(place.gen == PlaceGen::ALIGN){
+			const UniqueLayout& ofmL = place.getOfmL();
+			for(UniqueLayout::dataLen_t i = 0; i < ofmL.totLength(); ++i){
+				h.add(ofmL[i].tile.x).add(ofmL[i].tile.y);
+			}
+		}
+	}
+	return h.get();
+}
+
+void StdLayerEngine::searchPart(LNode* curNode, PlaceSch& placeSch, LayerScheme& layerSch, PruneCnt& cnt) const{
+	const Cluster& cluster = curNode->cluster;
+	const Node& layerT = curNode->layert;
+	const Layer& layer = layerT.layer();
+	const fmap_shape& ofmShape = layer.ofmap_shape();
+	const len_t totBatch = LNode::tot_batch;
+	const len_t B = curNode->num_batch;
+	const bool wgt_B = layerT.hasWgtPrevs();
+
+	const cidx_t numCores = cluster.num_cores();
+	const Core::Buffer& ubuf = mapper->core().ubuf();
+
+	const PartSch& partSch = placeSch.part;
+	assert(partSch.size() == static_cast<unsigned>(numCores));
+
+	SchNode::SchCost curCost;
+	// Bandwidth is only calculated in the final scheme (Sec. Update optimal scheme)
+	NoC noc(false);
+
+	// Init partition
+	initLayouts(placeSch, layerT, ofmShape, B);
+
+	// Estimate buffer usage
+	vol_t estimatedBuf = ofm_ubuf_vol;
+	estimatedBuf += placeSch.ifmLayout->maxRange();
+	estimatedBuf += placeSch.wgtLayout->maxRange();
+	if(estimatedBuf > ubuf.Size) return;
+
+	// Search for intra-tile dataflow
+	CoreMapper::CoreMapping tileSch = mapper->genLayerMap(layer, partSch, B, wgt_B);
+	if(!tileSch.cost.is_valid()) return;
+	curCost.energy = tileSch.cost.energy * numCores;
+	curCost.time = tileSch.cost.time;
+
+	// Calc ubuf energy
+	energy_t ubufWgt = placeSch.wgtLayout->totalSize() * ubuf.WCost;
+	// Pinned weight ubuf energy should only count once,
+	// thus divided by different batches.
+	if(!wgt_B && !curNode->wgt_stream) ubufWgt /= (totBatch / B);
+
+	energy_t ubufTotal = ubufWgt + ofmShape.tot_size(B) * ubuf.RCost;
+	ubufTotal += placeSch.ifmLayout->totalSize() * ubuf.WCost;
+	curCost.energy += ubufTotal;
+	++cnt.numParts;
+
+	// Lower bound of all placements (without NoC)
+	if(curCost.cost() >= layerSch.totCost.cost()){
+		++cnt.numPruned;
+		return;
+	}
+
+	// Iterate over all placements.
+	auto placeIter = placeEngine.init(placeSch, curCost.cost());
+	// Placement must yield at least one valid scheme
+	assert(placeIter);
+	bool firstPlace = true;
+	// Transfers of this partition, recorded in the first placement.
+	static thread_local NoC::Traffic traffic;
+	static thread_local pos_t alignPos[MAX_CHIPS];
 	do{
-		assert(partSch.size() == static_cast<unsigned>(numCores));
-
-		// Init partition
-		initLayouts(placeSch, layerT, ofmShape, B);
-
-		// Estimate buffer usage
-		vol_t estimatedBuf = ofm_ubuf_vol;
-		estimatedBuf += placeSch.ifmLayout->maxRange();
-		estimatedBuf += placeSch.wgtLayout->maxRange();
-		if(estimatedBuf > ubuf.Size) continue;
-
-		// Search for intra-tile dataflow
-		tileSch = mapper->genLayerMap(layer, partSch, B, wgt_B);
-		if(!tileSch.cost.is_valid()) continue;
-		curCost.energy = tileSch.cost.energy * numCores;
-		curCost.time = tileSch.cost.time;
-
-		// Calc ubuf energy
-		// TODO: default to not pinning weights.
-		energy_t ubufWgt = placeSch.wgtLayout->totalSize() * ubuf.WCost;
-		// weight ubuf energy should only count once,
-		// thus divided by different batches.
-		if(!wgt_B) ubufWgt /= (totBatch / B);
-
-		ubufTotal = ubufWgt + ubufOfm;
-		ubufTotal += placeSch.ifmLayout->totalSize() * ubuf.WCost;
-		curCost.energy += ubufTotal;
-
-		// Iterate over all placements.
-		auto placeIter = placeEngine.init(placeSch);
-		// Placement must yield at least one valid scheme
-		assert(placeIter);
-		do{
-			// Init placement
+		// Init placement
+		if(placeSch.gen == PlaceGen::ALIGN){
+			// ALIGN is never the first generator, so traffic is already recorded.
+			assert(!firstPlace);
+			if(!alignPlacement(placeSch, traffic, cluster, alignPos)) continue;
+			placeSch.initPlacement(cluster, alignPos);
+		}else{
 			placeSch.initPlacement(cluster);
+		}
 
+		if(firstPlace){
+			traffic.clear();
+			noc.record(&traffic);
 			calcNoC(noc, placeSch, curNode);
+			noc.record(nullptr);
+		}else{
+			// Only positions of tiles are changed.
+			noc.replay(traffic);
+		}
 
-			cycle_t nocTime = noc.get_time();
+		cycle_t nocTime = noc.get_time();
 
-			SchNode::SchCost curCostAll = curCost;
-			curCostAll.energy += noc.get_cost();
-			curCostAll.time = MAX(curCostAll.time, nocTime);
+		// DRAM access doesn't depend on placement, add it to the lower bound.
+		// (NoC time and per-port DRAM time do, so only the total DRAM time is used)
+		if(firstPlace){
+			SchNode::SchCost lowBound = curCost;
+			lowBound.energy += noc.get_DRAM_cost();
+			lowBound.time = MAX(lowBound.time, noc.get_DRAM_time_bound());
+			placeIter.setLowBound(lowBound.cost());
+			firstPlace = false;
+		}
 
-			// Update optimal cost
-			if(curCostAll.cost() < layerSch.totCost.cost()){
-				layerSch.totCost = curCostAll;
-				layerSch.extUbufEnergy = ubufTotal;
-				layerSch.tileSch = tileSch;
-				layerSch.place.update(std::move(placeSch));
-			}
-		}while(placeIter.nextPlace(/*curCost.cost()*/));
-	}while(partIter.nextPart(/*curCost.cost()*/));
+		SchNode::SchCost curCostAll = curCost;
+		curCostAll.energy += noc.get_cost();
+		curCostAll.time = MAX(curCostAll.time, nocTime);
 
-	/* ########## Update optimal scheme ########## */
+		// Update optimal cost
+		if(curCostAll.cost() < layerSch.totCost.cost()){
+			layerSch.totCost = curCostAll;
+			layerSch.extUbufEnergy = ubufTotal;
+			layerSch.tileSch = tileSch;
+			layerSch.place.update(std::move(placeSch));
+		}
+	}while(placeIter.nextPlace(layerSch.totCost.cost()));
+	if(placeIter.is_pruned()) ++cnt.numCut;
+}
 
-	if(layerSch.isValid()){
-		// Reuse allocated array
-		layerSch.place.ifmLayout = std::move(placeSch.ifmLayout);
-		layerSch.place.wgtLayout = std::move(placeSch.wgtLayout);
-		layerSch.place.ofmLayout = std::move(placeSch.ofmLayout);
-		layerSch.place.permuteOrder = std::move(placeSch.permuteOrder);
+/*
+ * Each tile is placed on the free core nearest to its main source, i.e. the
+ * core (or DRAM port) sending most of its ifmap & weight. Tiles with more
+ * data from their main source choose first, and tiles without one are
+ * placed on the remaining cores in the order of the cluster.
+ */
+bool StdLayerEngine::alignPlacement(const PlaceSch& place, const NoC::Traffic& traffic, const Cluster& cluster, pos_t* alignPos){
+	struct Src{
+		pos_t pos;
+		vol_t size;
+	};
+	const cidx_t numCores = cluster.num_cores();
+	static thread_local std::vector<Src> tileSrcs[MAX_CHIPS];
+	for(cidx_t t = 0; t < numCores; ++t) tileSrcs[t].clear();
+
+	auto addSrc = [](std::vector<Src>& srcs, pos_t pos, vol_t size){
+		for(Src& s: srcs){
+			if(s.pos == pos){
+				s.size += size;
+				return;
+			}
+		}
+		srcs.push_back({pos, size});
+	};
+	traffic.for_each_src([&](const DataLayout* layout, cidx_t idx, pos_t src, vol_t size){
+		assert(layout == place.ifmLayout.get() || layout == place.wgtLayout.get());
+		// Range "idx" is sent to tiles base + k * bcast_step (see StdDataLayout).
+		const auto* stdLayout = static_cast<const StdDataLayout*>(layout);
+		using dataLen_t = DataLayout::dataLen_t;
+		const dataLen_t step = stdLayout->bcast_step;
+		const dataLen_t base = (idx / step) * stdLayout->bcast_down + idx % step;
+		for(dataLen_t k = 0; k < stdLayout->bcast_len; ++k){
+			addSrc(tileSrcs[base + k * step], src, size);
+		}
+	});
+
+	// Main source of each tile.
+	pos_t mainSrc[MAX_CHIPS];
+	vol_t mainSize[MAX_CHIPS];
+	cidx_t tiles[MAX_CHIPS];
+	bool hasSrc = false;
+	for(cidx_t t = 0; t < numCores; ++t){
+		mainSize[t] = 0;
+		for(const Src& s: tileSrcs[t]){
+			if(s.size > mainSize[t]){
+				mainSrc[t] = s.pos;
+				mainSize[t] = s.size;
+			}
+		}
+		hasSrc |= (mainSize[t] > 0);
+		tiles[t] = t;
+	}
+	if(!hasSrc) return false;
+	std::stable_sort(tiles, tiles + numCores, [&](cidx_t a, cidx_t b){
+		return mainSize[a] > mainSize[b];
+	});
+
+	bool used[MAX_CHIPS] = {};
+	cidx_t nextFree = 0;
+	for(cidx_t i = 0; i < numCores; ++i){
+		const cidx_t t = tiles[i];
+		cidx_t core = numCores;
+		if(mainSize[t] > 0){
+			int minDist = 0;
+			for(cidx_t c = 0; c < numCores; ++c){
+				if(used[c]) continue;
+				const pos_t pos = cluster[c];
+				int dist = Topology::distance(pos, mainSrc[t]);
+				if(core == numCores || dist < minDist){
+					core = c;
+					minDist = dist;
+				}
+			}
+		}else{
+			while(used[nextFree]) ++nextFree;
+			core = nextFree;
+		}
+		used[core] = true;
+		alignPos[t] = cluster[core];
+	}
+	return true;
+}
 
-		/* ##### Re-calculate placement scheme & NoC ##### */
+/*
+ * Each task searches parts[t], parts[t+n], parts[t+2n], ... with its own
+ * buffers and best scheme. The results are then reduced in the order of
+ * partitions, so the chosen scheme is the same as in the serial search
+ * (the first one with the minimal cost).
+ */
+void StdLayerEngine::searchParts(LNode* curNode, const PartSch* parts, std::size_t numParts, LayerScheme& layerSch, PruneCnt& cnt) const{
+	const cidx_t numCores = curNode->cluster.num_cores();
+	const bool hasWgt = curNode->layert.layer().weight_size() > 0;
+
+	if(!pool){
+		PlaceSch& placeSch = scratchPlaceSch(numCores, hasWgt);
+		for(std::size_t i = 0; i < numParts; ++i){
+			placeSch.part = parts[i];
+			searchPart(curNode, placeSch, layerSch, cnt);
+		}
+		return;
+	}
 
-		// Init partition
-		initLayouts(layerSch.place, layerT, ofmShape, B);
+	const std::size_t numTasks = MIN(pool->size(), numParts);
+	if(numTasks == 0) return;
+
+	std::vector<LayerScheme> bestSch(numTasks);
+	std::vector<std::size_t> bestIdx(numTasks, numParts);
+	std::vector<PruneCnt> taskCnt(numTasks);
+
+	pool->run(numTasks, [&](std::size_t t){
+		PlaceSch& placeSch = scratchPlaceSch(numCores, hasWgt);
+		LayerScheme& best = bestSch[t];
+		for(std::size_t i = t; i < numParts; i += numTasks){
+			placeSch.part = parts[i];
+			cost_t lastCost = best.totCost.cost();
+			searchPart(curNode, placeSch, best, taskCnt[t]);
+			if(best.totCost.cost() < lastCost) bestIdx[t] = i;
+		}
+	});
+
+	// Reduce to the best scheme (break ties by index of partition).
+	std::size_t minTask = numTasks;
+	for(std::size_t t = 0; t < numTasks; ++t){
+		cnt.numParts += taskCnt[t].numParts;
+		cnt.numPruned += taskCnt[t].numPruned;
+		cnt.numCut += taskCnt[t].numCut;
+		if(bestIdx[t] == numParts) continue;
+		if(minTask == numTasks) {
+			minTask = t;
+			continue;
+		}
+		cost_t c = bestSch[t].totCost.cost(), minC = bestSch[minTask].totCost.cost();
+		if(c < minC || (c == minC && bestIdx[t] < bestIdx[minTask])) minTask = t;
+	}
+	if(minTask == numTasks) return;
 
-		// Init placement
-		layerSch.place.initPlacement(cluster);
+	LayerScheme& best = bestSch[minTask];
+	layerSch.totCost = best.totCost;
+	layerSch.extUbufEnergy = best.extUbufEnergy;
+	layerSch.tileSch = best.tileSch;
+	layerSch.place.update(std::move(best.place));
+}
 
-		// Finalize layerSch.place
-		layerSch.place.finalize();
+void StdLayerEngine::initPlaceSch(PlaceSch& place, cidx_t numCores, bool hasWgt){
+	pos_t* permOrder = new pos_t[numCores];
+	place.permuteOrder.reset(permOrder);
+	place.ifmLayout = std::make_unique<StdDataLayout>(numCores, permOrder);
+	if(hasWgt)
+		place.wgtLayout = std::make_unique<StdDataLayout>(numCores, permOrder);
+	else
+		place.wgtLayout = std::make_unique<StdDataLayout>(0, nullptr);
+	place.ofmLayout = std::make_unique<StdULayout>(numCores, permOrder);
+	// permOrder = nullptr; // Handled to place.permuteOrder
+}
 
-		// Update NoC
-		calcNoC(layerSch.noc, layerSch.place, curNode);
-	}
+PlaceSch& StdLayerEngine::scratchPlaceSch(cidx_t numCores, bool hasWgt){
+	// One buffer for each thread and each kind of layer, allocated at first use.
+	static thread_local std::unique_ptr<PlaceSch> scratch[2][MAX_CHIPS+1];
 
-	return layerSch;
+	assert(numCores <= MAX_CHIPS);
+	auto& place = scratch[hasWgt][numCores];
+	if(!place){
+		place = std::make_unique<PlaceSch>();
+		initPlaceSch(*place, numCores, hasWgt);
+	}
+	return *place;
 }
 
 void StdLayerEngine::initLayouts(PlaceSch& place, const Node& layerT, const fmap_shape& ofmShape, len_t B) const{
@@ -181,12 +590,12 @@ void StdLayerEngine::initLayouts(PlaceSch& place, const Node& layerT, const fmap
 	const bool hasWgt = layer.weight_size() > 0;
 	const bool wgt_B = layerT.hasWgtPrevs();
 
-	// Intervals on each dimension.
-	const len_t* arrs[4];
-	arrs[0] = part_intv(ofmShape.c, part.K);
-	arrs[1] = part_intv(B, part.B);
-	arrs[2] = part_intv(ofmShape.h, part.H);
-	arrs[3] = part_intv(ofmShape.w, part.W);
+	// Intervals on each dimension (each dim is cut into at most MAX_CHIPS parts).
+	len_t arrs[4][MAX_CHIPS+1];
+	part_intv(ofmShape.c, part.K, arrs[0]);
+	part_intv(B, part.B, arrs[1]);
+	part_intv(ofmShape.h, part.H, arrs[2]);
+	part_intv(ofmShape.w, part.W, arrs[3]);
 
 	/* ########## Set fmap layouts ########## */
 
@@ -277,20 +686,33 @@ void StdLayerEngine::initLayouts(PlaceSch& place, const Node& layerT, const fmap
 	if(eltLayer != nullptr){
 		ifmLayout.sizeMult(eltLayer->get_workload().N);
 	}
-
-	delete[] arrs[0];
-	delete[] arrs[1];
-	delete[] arrs[2];
-	delete[] arrs[3];
 }
 
-void StdLayerEngine::calcNoC(NoC& noc, const PlaceSch& place, LNode* curNode) const{
+void StdLayerEngine::calcNoC(NoC& noc, const PlaceSch& place, const LNode* curNode) const{
 	noc.clear();
 
 	const Node& layerT = curNode->layert;
 	const len_t B = curNode->num_batch;
 	const bool wgt_B = layerT.hasWgtPrevs();
 
+	// With NoC::dram_layout, a prev layer stored in DRAM is fetched from
+	// the MemULayout of its ofmap, if it is already scheduled.
+	// Partitions are searched in parallel, so lnodeList is only read (find, not operator[]).
+	const auto& lnodes = *(curNode->lnodeList);
+	auto memNode = [&lnodes](lid_t prev) -> const LNode*{
+		if(!NoC::dram_layout) return nullptr;
+		auto it = lnodes.find(prev);
+		if(it == lnodes.end() || it->second == nullptr) return nullptr;
+		if(dynamic_cast<const StdULayout*>(&it->second->get_place_sch().getOfmL()) == nullptr) return nullptr;
+		return it->second;
+	};
+	// Layers in dirp_set are always on the tree.
+	auto dirpNode = [&lnodes](lid_t prev) -> const LNode*{
+		auto it = lnodes.find(prev);
+		assert(it != lnodes.end() && it->second != nullptr);
+		return it->second;
+	};
+
 	len_t curC;
 
 	// Fetch weight first.
@@ -302,11 +724,13 @@ void StdLayerEngine::calcNoC(NoC& noc, const PlaceSch& place, LNode* curNode) co
 			const lid_t prev = it;
 			const len_t prevC = network->getNode(prev).layer().ofmap_shape().c;
 			if(curNode->get_dirp_set().contains(prev)){
-				const LNode* fromNode = (*(curNode->lnodeList))[prev];
+				const LNode* fromNode = dirpNode(prev);
 				const auto& fromLayout = fromNode->get_place_sch().getOfmL();
 				noc.betweenLayout(fromLayout, place.getWgtL(), curC, fromNode->num_batch, B);
+			}else if(const LNode* fromNode = memNode(prev)){
+				const auto& fromLayout = static_cast<const StdULayout&>(fromNode->get_place_sch().getOfmL());
+				noc.fromRemoteMem(MemULayout(fromLayout), place.getWgtL(), curC, fromNode->num_batch, B);
 			}else{
-				// TODO: Change to last layer's memLayout.
 				noc.fromRemoteMem(place.getWgtL(), curC, curC + prevC);
 			}
 			curC += prevC;
@@ -314,8 +738,8 @@ void StdLayerEngine::calcNoC(NoC& noc, const PlaceSch& place, LNode* curNode) co
 		assert(curC == layerT.layer().weight_shape().c);
 	}else{
 		noc.fromRemoteMem(place.getWgtL());
-		// Weight only need to fetch once. Thus divided by #bgrp.
-		noc.div(LNode::tot_batch / B);
+		// Pinned weight only need to fetch once. Thus divided by #bgrp.
+		if(!curNode->wgt_stream) noc.div(LNode::tot_batch / B);
 	}
 
 	// Identify eltwise first
@@ -343,11 +767,13 @@ void StdLayerEngine::calcNoC(NoC& noc, const PlaceSch& place, LNode* curNode) co
 		const lid_t prev = it;
 		const len_t prevC = network->getNode(prev).layer().ofmap_shape().c;
 		if(curNode->get_dirp_set().contains(prev)){
-			const LNode* fromNode = (*(curNode->lnodeList))[prev];
+			const LNode* fromNode = dirpNode(prev);
 			const auto& fromLayout = fromNode->get_place_sch().getOfmL();
 			noc.betweenLayout(fromLayout, place.getIfmL(), curC, fromNode->num_batch, B);
+		}else if(const LNode* fromNode = memNode(prev)){
+			const auto& fromLayout = static_cast<const StdULayout&>(fromNode->get_place_sch().getOfmL());
+			noc.fromRemoteMem(MemULayout(fromLayout), place.getIfmL(), curC, fromNode->num_batch, B);
 		}else{
-			// TODO: Change to last layer's memLayout.
 			noc.fromRemoteMem(place.getIfmL(), curC, curC + prevC);
 		}
 		curC += prevC;
@@ -366,15 +792,65 @@ void StdLayerEngine::calcNoC(NoC& noc, const PlaceSch& place, LNode* curNode) co
 
 	// Save to remote mem if necessary
 	if(curNode->to_dram){
-		noc.toRemoteMem(place.getOfmL());
+		const auto* ofmLayout = dynamic_cast<const StdULayout*>(&place.getOfmL());
+		if(NoC::dram_layout && ofmLayout != nullptr){
+			noc.toRemoteMem(MemULayout(*ofmLayout));
+		}else{
+			noc.toRemoteMem(place.getOfmL());
+		}
 	}
+}
 
-	/*
-	if(curNode->to_dram){
-		// TODO: change interleaving into 1-2 remote mems.
-		fmap_range ofmRange(ofmShape, totBatch);
-		placeSch.memLayout = std::make_unique<MemULayout>(ofmRange, NoC::dram_list.data(), NoC::dram_list.size());
-		layerSch.place.memLayout = std::make_unique<MemULayout>(ofmRange, NoC::dram_list.data(), NoC::dram_list.size());
+void StdLayerEngine::record_traffic(const LNode* node, NoC::Traffic& traffic) const{
+	traffic.clear();
+	NoC noc(false);
+	noc.record(&traffic);
+	calcNoC(noc, node->get_place_sch(), node);
+	noc.record(nullptr);
+}
+
+FastLayerEngine::FastLayerEngine(CoreMapper* _mapper, std::size_t _top_k, std::size_t num_threads)
+	:StdLayerEngine(_mapper, num_threads, _top_k){
+	if(_top_k == 0){
+		throw std::invalid_argument("FastLayerEngine needs top_k > 0!");
 	}
-	*/
+}
+
+/*
+ * The score of a partition is (replicated data volume) / (utilization):
+ *   utilization: same as in PartIter, product of util on each dimension.
+ *   ifmap is replicated on the K cuts (unless ifmap is cut with K),
+ *   weight is replicated on the H*W cuts (and the B cuts if shared by batches).
+ * Replicated data costs buffer, NoC hops and (multicasted) DRAM access.
+ */
+void FastLayerEngine::rankParts(LNode* curNode, std::vector<PartSch>& parts) const{
+	const Node& layerT = curNode->getLayer();
+	const Layer& layer = layerT.layer();
+	const fmap_shape& ofmShape = layer.ofmap_shape();
+	const len_t B = curNode->get_num_batch();
+	const bool fmap_K = layer.fmap_channel_rel();
+	const bool wgt_B = layerT.hasWgtPrevs();
+
+	const double ifmVol = layer.real_ifmap_shape().tot_size(B);
+	const double wgtVol = wgt_B ? layer.weight_size() * static_cast<double>(B) : layer.weight_size();
+
+	auto util = [](len_t real, len_t part) -> double{
+		return static_cast<double>(real) / (DIVCEIL(real, part) * part);
+	};
+
+	std::vector<std::pair<double, std::size_t>> score(parts.size());
+	for(std::size_t i = 0; i < parts.size(); ++i){
+		const PartSch& p = parts[i];
+		double u = util(ofmShape.c, p.K) * util(B, p.B) * util(ofmShape.h, p.H) * util(ofmShape.w, p.W);
+		double vol = ifmVol * (fmap_K ? 1 : p.K);
+		vol += wgtVol * p.H * p.W * (wgt_B ? 1 : p.B);
+		score[i] = {vol / u, i};
+	}
+	// Ties are kept in the original order.
+	std::sort(score.begin(), score.end());
+
+	std::vector<PartSch> sorted;
+	sorted.reserve(parts.size());
+	for(const auto& it: score) sorted.push_back(parts[it.second]);
+	parts.swap(sorted);
 }
@@ -0,0 +1,114 @@
+#include "layertable.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "layer.h"
+#include "network.h"
+#include "threadpool.h"
+
+
+LayerTable layerTable;
+
+LayerTable::LayerTable(): maxCores(0){}
+
+std::size_t LayerTable::index(lid_t layer, cidx_t numCores, std::size_t bIdx) const{
+	return (static_cast<std::size_t>(layer) * maxCores + (numCores - 1)) * batches.size() + bIdx;
+}
+
+void LayerTable::init(cidx_t max_cores, len_t tot_batch, vol_t ubuf_size, std::size_t num_threads){
+	assert(max_cores > 0 && tot_batch > 0);
+	maxCores = max_cores;
+
+	batches.clear();
+	batchIdx.assign(tot_batch + 1, -1);
+	for(len_t b = 1; b <= tot_batch; ++b){
+		if(tot_batch % b != 0) continue;
+		batchIdx[b] = static_cast<int>(batches.size());
+		batches.push_back(b);
+	}
+
+	const lid_t numLayers = network->len();
+	const std::size_t slots = static_cast<std::size_t>(maxCores) * batches.size();
+	entries.resize(numLayers * slots);
+
+	// Partitions of each layer, partBegin/partEnd are relative to the layer first.
+	std::vector<std::vector<std::uint16_t>> layerParts(numLayers);
+	auto initLayer = [&](std::size_t l){
+		const lid_t layerid = static_cast<lid_t>(l);
+		const Node& layerT = network->getNode(layerid);
+		const Layer& layer = layerT.layer();
+		const bool cutIfm = REF_IS_INSTANCE(layer, ConvLayer) && !REF_IS_INSTANCE(layer, GroupConvLayer);
+		auto& lparts = layerParts[l];
+		PartSch sch;
+		for(cidx_t numCores = 1; numCores <= maxCores; ++numCores){
+			const vol_t totUbufSize = ubuf_size * numCores;
+			for(std::size_t bIdx = 0; bIdx < batches.size(); ++bIdx){
+				const len_t B = batches[bIdx];
+				Entry& e = entries[index(layerid, numCores, bIdx)];
+
+				// Same as minBuf in StdLayerEngine::search.
+				vol_t minBuf = ofm_ubuf_vol;
+				minBuf += DIVCEIL(layerT.get_min_ifm_vol(B), static_cast<vol_t>(numCores));
+				minBuf += DIVCEIL(layerT.get_min_wgt_vol(B), static_cast<vol_t>(numCores));
+				e.fits = (minBuf <= ubuf_size);
+
+				e.minCuts = 0;
+				if(cutIfm)
+					e.minCuts = static_cast<len_t>(layer.real_ifmap_shape().tot_size(B) / (totUbufSize*0.8) + 1);
+
+				e.partBegin = e.partEnd = static_cast<std::uint32_t>(lparts.size());
+				if(!e.fits) continue;
+
+				auto partIter = partEngine.init(numCores, B, layerT, sch, e.minCuts);
+				if(!partIter) continue;
+				const auto& allParts = PartEngine::all_parts(numCores);
+				do{
+					auto it = std::find(allParts.begin(), allParts.end(), sch);
+					assert(it != allParts.end());
+					lparts.push_back(static_cast<std::uint16_t>(it - allParts.begin()));
+				}while(partIter.nextPart());
+				e.partEnd = static_cast<std::uint32_t>(lparts.size());
+			}
+		}
+	};
+
+	if(num_threads > 1){
+		ThreadPool pool(num_threads - 1);
+		pool.run(numLayers, initLayer);
+	}else{
+		for(lid_t l = 0; l < numLayers; ++l) initLayer(l);
+	}
+
+	// Concatenate partitions of all layers.
+	std::size_t totParts = 0;
+	for(const auto& lparts: layerParts) totParts += lparts.size();
+	partIdx.clear();
+	partIdx.reserve(totParts);
+	for(lid_t l = 0; l < numLayers; ++l){
+		const auto offset = static_cast<std::uint32_t>(partIdx.size());
+		for(std::size_t i = 0; i < slots; ++i){
+			Entry& e = entries[l * slots + i];
+			e.partBegin += offset;
+			e.partEnd += offset;
+		}
+		partIdx.insert(partIdx.end(), layerParts[l].begin(), layerParts[l].end());
+	}
+}
+
+const LayerTable::Entry* LayerTable::get(lid_t layer, cidx_t numCores, len_t B) const{
+	if(numCores == 0 || numCores > maxCores) return nullptr;
+	if(B >= batchIdx.size() || batchIdx[B] < 0) return nullptr;
+	return &entries[index(layer, numCores, static_cast<std::size_t>(batchIdx[B]))];
+}
+
+void LayerTable::get_parts(const Entry& entry, cidx_t numCores, std::vector<PartSch>& parts) const{
+	const auto& allParts = PartEngine::all_parts(numCores);
+	for(std::uint32_t i = entry.partBegin; i < entry.partEnd; ++i){
+		parts.push_back(allParts[partIdx[i]]);
+	}
+}
+
+std::size_t LayerTable::size() const{
+	return entries.size() * sizeof(Entry) + partIdx.size() * sizeof(std::uint16_t);
+}
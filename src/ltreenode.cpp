@@ -7,12 +7,12 @@
 
 LTreeNode::LTreeNode(const Bitset& _layer_set, len_t _num_batch, LTreeNode *_parent, NodeType _t)
 	:t((_t == NodeType::L&&_layer_set.count()>1)?(_parent->t == NodeType::S? NodeType::T : NodeType::S):_t),
-	 isNewNode(true), parent(_parent), layer_set(_layer_set), num_batch(_num_batch){
+	 isNewNode(true), parent(_parent), layer_set(_layer_set), num_batch(_num_batch), wgt_stream(false){
 	if(_parent) _parent->add(this);
 }
 
 LTreeNode::LTreeNode(lid_t _layer, len_t _num_batch, LTreeNode *_parent)
-	:t(NodeType::L), isNewNode(true), parent(_parent), layer_set(Bitset(_layer)), num_batch(_num_batch){
+	:t(NodeType::L), isNewNode(true), parent(_parent), layer_set(Bitset(_layer)), num_batch(_num_batch), wgt_stream(false){
 	if(_parent) _parent->add(this);
 }
 
@@ -64,6 +64,11 @@ void LTreeNode::reset_lset(){
 	layer_set.clear();
 }
 
+void LTreeNode::set_wgt_stream(bool stream){
+	assert(t == NodeType::L);
+	wgt_stream = stream;
+}
+
 LTreeNode::NodeType LTreeNode::get_type(){
 	return t;
 }
@@ -104,6 +109,10 @@ bool LTreeNode::get_to_dram() const{
 	return to_dram;
 }
 
+bool LTreeNode::get_wgt_stream() const{
+	return wgt_stream;
+}
+
 const Bitset& LTreeNode::get_dirp_set() const{
 	return dirp_set;
 }
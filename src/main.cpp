@@ -1,9 +1,14 @@
 #include "cluster.h"
+#include "layerdb.h"
 #include "layerengine.h"
+#include "layertable.h"
 #include "ltreenode.h"
 #include "nns/nns.h"
 #include "noc.h"
+#include "nocsim.h"
+#include "scheval.h"
 #include "schnode.h"
+#include "topology.h"
 #include "util.h"
 
 #include "sa.h" // Library for SA
@@ -12,6 +17,8 @@
 #include "json/json.h" // Json::StyledWriter
 #endif
 
+#include <algorithm>     // std::find
+#include <array>         // std::array
 #include <cassert>       // assert
 #include <cmath>         // std::pow
 #include <cstdlib>       // std::srand, std::atoi
@@ -19,9 +26,11 @@
 #include <fstream>       // std::ifstream, std::ofstream
 #include <functional>    // std::ref
 #include <iostream>      // std::cin, std::cout, std::endl
+#include <memory>        // std::unique_ptr
 #include <string>        // std::string
 #include <thread>        // std::thread
 #include <unordered_map> // std::unordered_map
+#include <vector>        // std::vector
 
 static const std::unordered_map<std::string, const Network *> All_Networks = {
     {"resnet", &resnet50},
@@ -99,6 +108,57 @@ int main(int argc, char **argv) {
   // Rounds of SA = urounds * #layers
   int urounds = 100;
 
+  // Threads used to search partitions of one layer (1: serial).
+  int layer_threads = 1;
+
+  // SA searches only the top-k partitions of each layer (FastLayerEngine)
+  // in the first fast_ratio of all rounds (0: disabled).
+  int fast_topk = 0;
+  double fast_ratio = 0.5;
+
+  // Whether ofmaps in DRAM are stored on the DRAM port nearest to
+  // each core (MemULayout), instead of interleaved on all ports.
+  bool dram_layout = false;
+
+  // DRAM ports (x, y, bandwidth), one "dram_port x y bw" line each.
+  // Empty: ports on the left and right columns sharing the DRAM bandwidth.
+  // bw 0: an even share of the DRAM bandwidth.
+  std::vector<std::array<int, 3>> dram_ports;
+
+  // NoC topology (see topology.h): wrap-around links, express links,
+  // chiplet size (0: one chiplet), D2D bandwidth (0: noc_bw / 4) and
+  // energy of a D2D hop (relative to a normal hop).
+  bool torus = false;
+  int express = 0;
+  int chiplet_x = 0, chiplet_y = 0;
+  int d2d_bw = 0;
+  double d2d_cost = 4;
+
+  // Unicast routings tried for each layer (bitmask of NoC::Routing, 1: XY).
+  int routing = 1;
+
+  // Whether multicasts use the cheapest trunk (Steiner) tree instead of the XY tree.
+  bool steiner = false;
+
+  // Whether NoC time is bounded in each phase (SchNode::phase_noc).
+  bool phase_noc = false;
+
+  // Placement generators to search (bitmask of PlaceGen, 1: order only).
+  int place_gen = 1;
+
+  // File of the layer scheme database shared across runs (empty: not used).
+  std::string layer_db;
+
+  // Whether prints the cost breakdown CSV, and the link load CSV & hotspots
+  // of the final schemes.
+  bool print_breakdown = false;
+  bool print_links = false;
+
+  // Whether simulates the NoC of the final schemes (see nocsim.h),
+  // with sim_channels buffers per link (0: unlimited).
+  bool noc_sim = false;
+  int sim_channels = 0;
+
 #ifndef NOT_GEN_IR
   // Whether generate IR or not.
   bool gen_IR = true;
@@ -172,6 +232,48 @@ int main(int argc, char **argv) {
           in >> cf_param;
         } else if (config_name == "round") {
           in >> urounds;
+        } else if (config_name == "layer_threads") {
+          in >> layer_threads;
+        } else if (config_name == "fast_topk") {
+          in >> fast_topk;
+        } else if (config_name == "fast_ratio") {
+          in >> fast_ratio;
+        } else if (config_name == "dram_layout") {
+          in >> dram_layout;
+        } else if (config_name == "dram_port") {
+          std::array<int, 3> port;
+          in >> port[0] >> port[1] >> port[2];
+          dram_ports.push_back(port);
+        } else if (config_name == "torus") {
+          in >> torus;
+        } else if (config_name == "express") {
+          in >> express;
+        } else if (config_name == "chiplet_x") {
+          in >> chiplet_x;
+        } else if (config_name == "chiplet_y") {
+          in >> chiplet_y;
+        } else if (config_name == "d2d_bw") {
+          in >> d2d_bw;
+        } else if (config_name == "d2d_cost") {
+          in >> d2d_cost;
+        } else if (config_name == "routing") {
+          in >> routing;
+        } else if (config_name == "steiner") {
+          in >> steiner;
+        } else if (config_name == "phase_noc") {
+          in >> phase_noc;
+        } else if (config_name == "place_gen") {
+          in >> place_gen;
+        } else if (config_name == "layer_db") {
+          in >> layer_db;
+        } else if (config_name == "print_breakdown") {
+          in >> print_breakdown;
+        } else if (config_name == "print_links") {
+          in >> print_links;
+        } else if (config_name == "noc_sim") {
+          in >> noc_sim;
+        } else if (config_name == "sim_channels") {
+          in >> sim_channels;
 #ifndef NOT_GEN_IR
         } else if (config_name == "IR") {
           in >> gen_IR;
@@ -207,14 +309,52 @@ int main(int argc, char **argv) {
     NoC::dram_list[y] = {0, y};
     NoC::dram_list[y_len + y] = {static_cast<mlen_t>(x_len - 1), y};
   }
+  NoC::dram_layout = dram_layout;
+  SchNode::phase_noc = phase_noc;
+
+  // ALIGN needs the traffic recorded with another generator.
+  const int gen_all = (1 << static_cast<int>(PlaceGen::NUM)) - 1;
+  const int gen_align = 1 << static_cast<int>(PlaceGen::ALIGN);
+  if (place_gen <= 0 || place_gen > gen_all || (place_gen & ~gen_align) == 0) {
+    throw std::invalid_argument("place_gen should be a bitmask in [1, " +
+                                std::to_string(gen_all) +
+                                "] with a generator other than ALIGN!");
+  }
+  PlaceEngine::gen_mask = static_cast<std::uint8_t>(place_gen);
+
+  const int routing_all = (1 << static_cast<int>(NoC::Routing::NUM)) - 1;
+  if (routing <= 0 || routing > routing_all) {
+    throw std::invalid_argument("routing should be a bitmask in [1, " +
+                                std::to_string(routing_all) + "]!");
+  }
+  NoC::routing_mask = static_cast<std::uint8_t>(routing);
+  NoC::steiner = steiner;
+
+  if (sim_channels < 0) {
+    throw std::invalid_argument("sim_channels should be non-negative!");
+  }
 
   // Core/LayerEngine initialization
   Core *core;
   CoreMapper *cMapper;
   init_core(core_type, core, cMapper);
-  StdLayerEngine engine(cMapper);
+  if (layer_threads < 1) {
+    throw std::invalid_argument("layer_threads should be at least 1!");
+  }
+  StdLayerEngine engine(cMapper, layer_threads);
   SchNode::layerMapper = &engine;
 
+  std::unique_ptr<FastLayerEngine> fastEngine;
+  if (fast_topk > 0) {
+    if (fast_ratio < 0 || fast_ratio >= 1) {
+      throw std::invalid_argument("fast_ratio should be in [0, 1)!");
+    }
+    fastEngine = std::make_unique<FastLayerEngine>(cMapper, fast_topk,
+                                                   layer_threads);
+    SAEngine::fastMapper = fastEngine.get();
+    SAEngine::fast_ratio = fast_ratio;
+  }
+
   // Cluster initialization
   Cluster::xlen = x_len;
   Cluster::ylen = y_len;
@@ -236,6 +376,46 @@ int main(int argc, char **argv) {
                                 std::to_string(NoC::NoC_bw));
   }
 
+  // Sets DRAM ports from config
+  if (!dram_ports.empty()) {
+    const int num_ports = static_cast<int>(dram_ports.size());
+    const int share = MAX(NoC::DRAM_bw / num_ports, 1);
+    NoC::dram_list.clear();
+    for (const auto &port : dram_ports) {
+      if (port[0] < 0 || port[0] >= x_len || port[1] < 0 || port[1] >= y_len ||
+          port[2] < 0 || port[2] > UINT16_MAX) {
+        delete core;
+        delete cMapper;
+        throw std::invalid_argument(
+            "DRAM port (" + std::to_string(port[0]) + ", " +
+            std::to_string(port[1]) + ") with bandwidth " +
+            std::to_string(port[2]) + " is out of range!");
+      }
+      pos_t pos = {static_cast<mlen_t>(port[0]),
+                   static_cast<mlen_t>(port[1])};
+      if (std::find(NoC::dram_list.begin(), NoC::dram_list.end(), pos) !=
+          NoC::dram_list.end()) {
+        delete core;
+        delete cMapper;
+        throw std::invalid_argument("Duplicated DRAM port (" +
+                                    std::to_string(port[0]) + ", " +
+                                    std::to_string(port[1]) + ")!");
+      }
+      NoC::dram_list.push_back(pos);
+      NoC::dram_port_bw.push_back(
+          static_cast<bw_t>((port[2] > 0) ? port[2] : share));
+    }
+  }
+
+  // Sets NoC topology
+  Topology::torus = torus;
+  Topology::express = static_cast<mlen_t>(express);
+  Topology::chiplet_x = static_cast<mlen_t>(chiplet_x);
+  Topology::chiplet_y = static_cast<mlen_t>(chiplet_y);
+  Topology::d2d_bw = static_cast<bw_t>((d2d_bw > 0) ? d2d_bw : MAX(noc_bw / 4, 1));
+  Topology::d2d_cost = d2d_cost;
+  Topology::init();
+
   // Sets networks
   {
     auto it = All_Networks.find(net_name);
@@ -275,6 +455,30 @@ int main(int argc, char **argv) {
   // Sets NPT
   network->set_utime(*cMapper);
 
+  // Precomputes static infos of all layers
+  layerTable.init(Cluster::xlen * Cluster::ylen, tot_batch,
+                  cMapper->core().ubuf().Size, layer_threads);
+
+  // Opens the layer scheme database, keyed by all global configs
+  if (!layer_db.empty()) {
+    LayerDB::Hasher h;
+    h.add(core_type).add(net_name).add(tot_batch);
+    h.add(Cluster::xlen).add(Cluster::ylen).add(Cluster::stride);
+    h.add(Cluster::min_util).add(ofm_ubuf_vol).add(cf_param);
+    h.add(NoC::hop_cost).add(NoC::DRAM_acc_cost).add(NoC::DRAM_bw);
+    h.add(NoC::NoC_bw).add(NoC::dram_layout).add(PlaceEngine::gen_mask);
+    h.add(Topology::torus).add(Topology::express);
+    h.add(Topology::chiplet_x).add(Topology::chiplet_y);
+    h.add(Topology::d2d_bw).add(Topology::d2d_cost).add(NoC::routing_mask);
+    h.add(NoC::steiner);
+    h.add(NoC::dram_list.size());
+    for (std::size_t i = 0; i < NoC::dram_list.size(); ++i) {
+      h.add(NoC::dram_list[i].x).add(NoC::dram_list[i].y);
+      h.add(NoC::dram_port_bw.empty() ? bw_t(0) : NoC::dram_port_bw[i]);
+    }
+    layerDB.open(layer_db, h.get().key);
+  }
+
   // Sets SA rounds
   lid_t num_layer = network->len();
   SAEngine::nrounds = urounds * num_layer;
@@ -309,9 +513,12 @@ int main(int argc, char **argv) {
   }
   if (init_tree) {
     std::cout << exp_name << "init: " << init_res << std::endl;
+    // Evaluated once for the summary check, breakdown, links and NoC simulation.
+    SchEval eval(init_res);
+    eval.eval();
     if (print_summary) {
       std::ofstream out(exp_name + "init_summary.txt");
-      init_res->print_summary(out);
+      init_res->print_summary(out, &eval);
     }
     if (print_scheme) {
       std::ofstream out(exp_name + "init_scheme.txt");
@@ -321,6 +528,22 @@ int main(int argc, char **argv) {
       std::ofstream out(exp_name + "init_tree.txt");
       init_res->print_tree("", out);
     }
+    if (print_breakdown) {
+      std::ofstream out(exp_name + "init_breakdown.csv");
+      eval.print_breakdown(out);
+    }
+    if (print_links) {
+      std::ofstream out(exp_name + "init_links.csv");
+      eval.print_links(out);
+      std::ofstream hot(exp_name + "init_hotspots.txt");
+      eval.print_hotspots(hot);
+    }
+    if (noc_sim) {
+      std::ofstream out(exp_name + "init_nocsim.txt");
+      std::ofstream csv(exp_name + "init_nocsim.csv");
+      NoCSim sim(sim_channels);
+      sim.simulate(eval, engine, out, csv);
+    }
   } else {
     std::cout << exp_name + "init finds no valid solution." << std::endl;
     return 0;
@@ -358,9 +581,11 @@ int main(int argc, char **argv) {
     }
     if (cur_sch) {
       std::cout << exp_name << method << ": " << cur_sch.sch << std::endl;
+      SchEval eval(cur_sch.sch);
+      eval.eval();
       if (print_summary) {
         std::ofstream out(exp_name + method + "_summary.txt");
-        cur_sch.sch->print_summary(out);
+        cur_sch.sch->print_summary(out, &eval);
       }
       if (print_scheme) {
         std::ofstream out(exp_name + method + "_scheme.txt");
@@ -370,6 +595,22 @@ int main(int argc, char **argv) {
         std::ofstream out(exp_name + method + "_tree.txt");
         cur_sch.sch->print_tree("", out);
       }
+      if (print_breakdown) {
+        std::ofstream out(exp_name + method + "_breakdown.csv");
+        eval.print_breakdown(out);
+      }
+      if (print_links) {
+        std::ofstream out(exp_name + method + "_links.csv");
+        eval.print_links(out);
+        std::ofstream hot(exp_name + method + "_hotspots.txt");
+        eval.print_hotspots(hot);
+      }
+      if (noc_sim) {
+        std::ofstream out(exp_name + method + "_nocsim.txt");
+        std::ofstream csv(exp_name + method + "_nocsim.csv");
+        NoCSim sim(sim_channels);
+        sim.simulate(eval, engine, out, csv);
+      }
 
 #ifndef NOT_GEN_IR
       if (gen_IR) {
@@ -421,9 +662,11 @@ int main(int argc, char **argv) {
     }
     if (SA_sch) {
       std::cout << exp_name << method << ": " << SA_sch.sch << std::endl;
+      SchEval eval(SA_sch.sch);
+      eval.eval();
       if (print_summary) {
         std::ofstream out(exp_name + method + "_summary.txt");
-        SA_sch.sch->print_summary(out);
+        SA_sch.sch->print_summary(out, &eval);
       }
       if (print_scheme) {
         std::ofstream out(exp_name + method + "_scheme.txt");
@@ -433,6 +676,22 @@ int main(int argc, char **argv) {
         std::ofstream out(exp_name + method + "_tree.txt");
         SA_sch.sch->print_tree("", out);
       }
+      if (print_breakdown) {
+        std::ofstream out(exp_name + method + "_breakdown.csv");
+        eval.print_breakdown(out);
+      }
+      if (print_links) {
+        std::ofstream out(exp_name + method + "_links.csv");
+        eval.print_links(out);
+        std::ofstream hot(exp_name + method + "_hotspots.txt");
+        eval.print_hotspots(hot);
+      }
+      if (noc_sim) {
+        std::ofstream out(exp_name + method + "_nocsim.txt");
+        std::ofstream csv(exp_name + method + "_nocsim.csv");
+        NoCSim sim(sim_channels);
+        sim.simulate(eval, engine, out, csv);
+      }
 
 #ifndef NOT_GEN_IR
       if (gen_IR) {
@@ -460,6 +719,9 @@ int main(int argc, char **argv) {
   our_search("SET", init_sch).del();
   // our_search("SET-min", min_sch).del();
 
+  engine.print_stats();
+  layerDB.print_stats();
+
   init_sch.del();
   min_sch.del();
 
@@ -18,10 +18,62 @@ const fmap_shape& InputData::get_shape() const{
 	return data_shape;
 }
 
+namespace {
+	/*
+	 * Volume of the union of map(ofm point) over all points of the ofmap
+	 * (one batch), where map is ofm_to_ifm or ofm_to_wgt.
+	 *
+	 * Since each core holds map(its ofm tile) for a partition, and each
+	 * tile covers some points, this is a lower bound of the total volume.
+	 * All maps are separable and monotonic (each dim of the result only
+	 * depends on one dim of ofm), so the union is a box, and we sweep each
+	 * ofm dim alone to get the length of each side.
+	 */
+	vol_t min_cover(const Layer& l, bool wgt){
+		typedef fmap_range::dim_range fmap_range::* dim_t;
+		const dim_t dims[4] = {&fmap_range::c, &fmap_range::b, &fmap_range::h, &fmap_range::w};
+		const fmap_shape& shape = l.ofmap_shape();
+		const len_t lens[4] = {shape.c, 1, shape.h, shape.w};
+
+		vol_t side[4] = {0, 0, 0, 0};
+		for(int d = 0; d < 4; ++d){
+			vol_t len[4] = {0, 0, 0, 0};
+			len_t end[4] = {0, 0, 0, 0};
+			for(len_t o = 0; o < lens[d]; ++o){
+				fmap_range r({0, 1}, {0, 1}, {0, 1}, {0, 1});
+				r.*dims[d] = {o, o+1};
+				if(wgt){
+					l.ofm_to_wgt(r);
+				}else{
+					l.ofm_to_ifm(r);
+				}
+				for(int i = 0; i < 4; ++i){
+					const auto& cur = r.*dims[i];
+					if(cur.to <= end[i]) continue;
+					len[i] += cur.to - MAX(cur.from, end[i]);
+					end[i] = cur.to;
+				}
+			}
+			for(int i = 0; i < 4; ++i){
+				side[i] = MAX(side[i], len[i]);
+			}
+		}
+		return side[0] * side[1] * side[2] * side[3];
+	}
+}
+
 Node::Node(const Layer* _l, const Bitset& _ifmPrevs, len_t _external_C, bwidth_t width, const Bitset& _wgtPrevs)
 	:l(_l), ifmPrevs(_ifmPrevs), wgtPrevs(_wgtPrevs), prevs(_ifmPrevs | _wgtPrevs), external_C(_external_C)
 {
 	if(width > 0) const_cast<Layer*>(_l)->set_bitwidth(width);
+
+	min_ifm_vol = min_cover(*l, false);
+	// Eltwise layer reads N ifmaps for each ofmap.
+	auto* eltLayer = dynamic_cast<const EltwiseLayer*>(l.get());
+	if(eltLayer != nullptr){
+		min_ifm_vol *= eltLayer->get_workload().N;
+	}
+	min_wgt_vol = (l->weight_size() > 0) ? min_cover(*l, true) : 0;
 }
 
 const Layer& Node::layer() const{
@@ -32,6 +84,15 @@ const std::string& Node::name() const{
 	return l->get_name();
 }
 
+vol_t Node::get_min_ifm_vol(len_t B) const{
+	return min_ifm_vol * B;
+}
+
+vol_t Node::get_min_wgt_vol(len_t B) const{
+	// Weights from prev layers have batch dim.
+	return hasWgtPrevs() ? min_wgt_vol * B : min_wgt_vol;
+}
+
 const Bitset& Node::getIfmPrevs() const{
 	return ifmPrevs;
 }
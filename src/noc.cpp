@@ -2,10 +2,13 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstdlib>
+#include <limits>
 #include <stdexcept>
 
 #include "cluster.h"
 #include "datalayout.h"
+#include "topology.h"
 #include "util.h"
 
 
@@ -14,8 +17,58 @@ energy_t NoC::DRAM_acc_cost;
 bw_t NoC::DRAM_bw;
 bw_t NoC::NoC_bw;
 std::vector<pos_t> NoC::dram_list;
+std::vector<bw_t> NoC::dram_port_bw;
+bool NoC::dram_layout = false;
+std::uint8_t NoC::routing_mask = 1;
+bool NoC::steiner = false;
 
-NoC::NoC(bool _calc_bw): calc_bw(_calc_bw), tot_hops(0), tot_DRAM_acc(0){}
+const pos_t& NoC::nearest_dram(pos_t core){
+	return dram_list[nearest_dram_idx(core)];
+}
+
+std::size_t NoC::nearest_dram_idx(pos_t core){
+	assert(!dram_list.empty());
+	std::size_t best = 0;
+	int best_dist = std::numeric_limits<int>::max();
+	for(std::size_t i = 0; i < dram_list.size(); ++i){
+		int dist = Topology::distance(dram_list[i], core);
+		if(dist < best_dist){
+			best = i;
+			best_dist = dist;
+		}
+	}
+	return best;
+}
+
+std::size_t NoC::dram_idx(pos_t port){
+	for(std::size_t i = 0; i < dram_list.size(); ++i){
+		if(dram_list[i] == port) return i;
+	}
+	assert(false);
+	return 0;
+}
+
+void NoC::get_route(pos_t src, const pos_t* dst, cidx_t len, Routing routing, std::vector<std::pair<std::int32_t, double>>& links){
+	assert(routing != Routing::ADAPTIVE && len > 0);
+	static thread_local NoC noc;
+	noc.clear();
+	noc.set_routing(routing);
+	// With size 2, O1TURN puts one on each half.
+	if(len == 1){
+		noc.unicastCalc(src, *dst, 2);
+	}else{
+		noc.multicastCalc(src, dst, len, 2);
+	}
+
+	links.clear();
+	noc.link_hops.flush();
+	const auto& hops = noc.link_hops.link_hops;
+	for(HopCount::linkIdx_t i = 0; i < static_cast<HopCount::linkIdx_t>(hops.size()); ++i){
+		if(hops[i] != 0) links.emplace_back(i, hops[i] / 2.0);
+	}
+}
+
+NoC::NoC(bool _calc_bw): calc_bw(_calc_bw), routing(Routing::XY), tot_hops(0), tot_d2d_hops(0), tot_DRAM_acc(0), rec(nullptr){}
 
 NoC NoC::operator+(const NoC& other) const{
 	NoC x = *this;
@@ -24,7 +77,15 @@ NoC NoC::operator+(const NoC& other) const{
 
 NoC& NoC::operator+=(const NoC& other){
 	tot_hops += other.tot_hops;
+	tot_d2d_hops += other.tot_d2d_hops;
 	tot_DRAM_acc += other.tot_DRAM_acc;
+	if(!other.port_acc.empty()){
+		if(port_acc.empty()){
+			port_acc = other.port_acc;
+		}else{
+			for(std::size_t i = 0; i < port_acc.size(); ++i) port_acc[i] += other.port_acc[i];
+		}
+	}
 	if(calc_bw || other.calc_bw){
 		assert(calc_bw && other.calc_bw);
 		link_hops += other.link_hops;
@@ -39,43 +100,188 @@ NoC NoC::operator*(const len_t& batch) const{
 
 NoC& NoC::operator*=(const len_t& batch){
 	tot_hops *= batch;
+	tot_d2d_hops *= batch;
 	tot_DRAM_acc *= batch;
+	for(access_t& acc: port_acc) acc *= batch;
 	if(calc_bw) link_hops *= batch;
 	return *this;
 }
 
 NoC& NoC::operator/=(const len_t& batch){
 	tot_hops /= batch;
+	tot_d2d_hops /= batch;
 	tot_DRAM_acc /= batch;
+	for(access_t& acc: port_acc) acc /= batch;
 	if(calc_bw) link_hops /= batch;
 	return *this;
 }
 
 void NoC::div(len_t batch){
+	if(rec) rec->flows.push_back({Traffic::Kind::DIV, 0, {0, 0}, batch, nullptr});
 	tot_hops /= batch;
+	tot_d2d_hops /= batch;
 	tot_DRAM_acc /= batch;
+	for(access_t& acc: port_acc) acc /= batch;
 	if(calc_bw) link_hops.div(batch);
 }
 
 void NoC::clear(){
 	tot_hops = 0;
+	tot_d2d_hops = 0;
 	tot_DRAM_acc = 0;
+	port_acc.clear();
 	link_hops.clear();
 }
 
+void NoC::Traffic::clear(){
+	flows.clear();
+}
+
+void NoC::Traffic::get_transfers(std::vector<Transfer>& transfers) const{
+	const std::size_t first = transfers.size();
+	const std::size_t numPorts = dram_list.size();
+	for(const auto& f: flows){
+		if(f.kind == Kind::DIV){
+			for(std::size_t i = first; i < transfers.size(); ++i) transfers[i].size /= f.size;
+			continue;
+		}
+		if(f.kind == Kind::TO_DRAM || f.kind == Kind::TO_MEM){
+			const pos_t& tile = (*static_cast<const UniqueLayout*>(f.layout))[f.idx].tile;
+			if(f.kind == Kind::TO_MEM){
+				const std::size_t port = nearest_dram_idx(tile);
+				transfers.push_back({tile, {dram_list[port]}, static_cast<double>(f.size), static_cast<int>(port)});
+				continue;
+			}
+			for(std::size_t i = 0; i < numPorts; ++i){
+				transfers.push_back({tile, {dram_list[i]}, static_cast<double>(f.size) / numPorts, static_cast<int>(i)});
+			}
+			continue;
+		}
+
+		auto it = f.layout->at(f.idx);
+		std::vector<pos_t> dst(it.tiles, it.tiles + it.numTile);
+		switch(f.kind){
+		case Kind::FROM_DRAM:
+			for(std::size_t i = 0; i < numPorts; ++i){
+				transfers.push_back({dram_list[i], dst, static_cast<double>(f.size) / numPorts, static_cast<int>(i)});
+			}
+			break;
+		case Kind::BETWEEN:
+			transfers.push_back({f.src, std::move(dst), static_cast<double>(f.size), -1});
+			break;
+		case Kind::FROM_MEM:
+			transfers.push_back({f.src, std::move(dst), static_cast<double>(f.size), static_cast<int>(dram_idx(f.src))});
+			break;
+		default:
+			assert(false);
+		}
+	}
+}
+
+void NoC::set_routing(Routing r){
+	routing = r;
+}
+
+NoC::Routing NoC::get_routing() const{
+	return routing;
+}
+
+void NoC::record(Traffic* traffic){
+	rec = traffic;
+}
+
+void NoC::replay(const Traffic& traffic){
+	clear();
+	for(const auto& f: traffic.flows){
+		switch(f.kind){
+		case Traffic::Kind::FROM_DRAM:{
+			auto it = f.layout->at(f.idx);
+			if(it.numTile == 1){
+				unicast_from_dram(it.tiles[0], f.size);
+			}else{
+				multicast_from_dram(it.tiles, it.numTile, f.size);
+			}
+			break;
+		}
+		case Traffic::Kind::TO_DRAM:
+			unicast_to_dram((*static_cast<const UniqueLayout*>(f.layout))[f.idx].tile, f.size);
+			break;
+		case Traffic::Kind::BETWEEN:{
+			auto it = f.layout->at(f.idx);
+			if(it.numTile == 1){
+				tot_hops += unicastCalc(f.src, *it.tiles, f.size);
+			}else{
+				tot_hops += multicastCalc(f.src, it.tiles, it.numTile, f.size);
+			}
+			break;
+		}
+		case Traffic::Kind::FROM_MEM:{
+			auto it = f.layout->at(f.idx);
+			if(it.numTile == 1){
+				tot_hops += unicastCalc(f.src, *it.tiles, f.size);
+			}else{
+				tot_hops += multicastCalc(f.src, it.tiles, it.numTile, f.size);
+			}
+			tot_DRAM_acc += f.size;
+			if(!dram_port_bw.empty()) add_port_acc(dram_idx(f.src), f.size);
+			break;
+		}
+		case Traffic::Kind::TO_MEM:{
+			const pos_t& tile = (*static_cast<const UniqueLayout*>(f.layout))[f.idx].tile;
+			std::size_t port = nearest_dram_idx(tile);
+			unicast(tile, dram_list[port], f.size);
+			tot_DRAM_acc += f.size;
+			if(!dram_port_bw.empty()) add_port_acc(port, f.size);
+			break;
+		}
+		case Traffic::Kind::DIV:
+			div(f.size);
+			break;
+		}
+	}
+}
+
+void NoC::add_port_acc(std::size_t port, access_t size){
+	if(port_acc.empty()) port_acc.resize(dram_list.size(), 0);
+	port_acc[port] += size;
+}
+
 cycle_t NoC::get_time() const{
-	cycle_t dram_time = DIVCEIL(tot_DRAM_acc, DRAM_bw);
+	cycle_t dram_time = 0;
+	if(dram_port_bw.empty()){
+		dram_time = DIVCEIL(tot_DRAM_acc, DRAM_bw);
+	}else{
+		// The busiest port (relative to its bandwidth) bounds DRAM time.
+		for(std::size_t i = 0; i < port_acc.size(); ++i){
+			dram_time = MAX(dram_time, static_cast<cycle_t>(DIVCEIL(port_acc[i], dram_port_bw[i])));
+		}
+	}
 	if(!calc_bw) return dram_time;
+	if(Topology::has_d2d()){
+		// D2D links have a lower bandwidth.
+		hop_t localMax, d2dMax;
+		link_hops.max(localMax, d2dMax);
+		cycle_t noc_time = MAX(DIVCEIL(localMax, NoC_bw), DIVCEIL(d2dMax, Topology::d2d_bw));
+		return MAX(dram_time, noc_time);
+	}
 	cycle_t noc_time = DIVCEIL(link_hops.max(), NoC_bw);
 	return MAX(dram_time, noc_time);
 }
 
+cycle_t NoC::get_DRAM_time_bound() const{
+	if(dram_port_bw.empty()) return DIVCEIL(tot_DRAM_acc, DRAM_bw);
+	access_t tot_bw = 0;
+	for(bw_t bw: dram_port_bw) tot_bw += bw;
+	return DIVCEIL(tot_DRAM_acc, tot_bw);
+}
+
 energy_t NoC::get_cost() const{
 	return get_hop_cost() + get_DRAM_cost();
 }
 
 energy_t NoC::get_hop_cost() const{
-	return tot_hops * hop_cost;
+	// D2D hops are included in tot_hops.
+	return tot_hops * hop_cost + tot_d2d_hops * (Topology::d2d_cost - 1) * hop_cost;
 }
 
 energy_t NoC::get_DRAM_cost() const{
@@ -94,12 +300,17 @@ NoC::hop_t NoC::get_max_link() const{
 	return link_hops.max();
 }
 
+const std::vector<access_t>& NoC::get_port_acc() const{
+	return port_acc;
+}
+
 void NoC::fromRemoteMem(const DataLayout& toLayout){
 	auto rLen = toLayout.rangeLength();
 	for(cidx_t i=0; i<rLen; ++i){
 		auto it = toLayout.at(i);
 		vol_t curSize = it.range.size();
 		if(curSize <= 0) continue;
+		if(rec) rec->flows.push_back({Traffic::Kind::FROM_DRAM, i, {0, 0}, curSize, &toLayout});
 		if(it.numTile == 1){
 			unicast_from_dram(it.tiles[0], curSize);
 		}else{
@@ -119,6 +330,7 @@ void NoC::fromRemoteMem(const DataLayout& toLayout, len_t fromC, len_t toC){
 		range.c = range.c.intersect(truncRange);
 		vol_t curSize = range.size();
 		if(curSize <= 0) continue;
+		if(rec) rec->flows.push_back({Traffic::Kind::FROM_DRAM, i, {0, 0}, curSize, &toLayout});
 		if(it.numTile == 1){
 			unicast_from_dram(it.tiles[0], curSize);
 		}else{
@@ -132,10 +344,60 @@ void NoC::toRemoteMem(const UniqueLayout& fromLayout){
 		auto it = fromLayout[i];
 		vol_t curSize = it.range.size();
 		if(curSize <= 0) continue;
+		if(rec) rec->flows.push_back({Traffic::Kind::TO_DRAM, i, {0, 0}, curSize, &fromLayout});
 		unicast_to_dram(it.tile, curSize);
 	}
 }
 
+void NoC::toRemoteMem(const MemULayout& memLayout){
+	const UniqueLayout& fromLayout = memLayout.getOfmL();
+	for(cidx_t i=0; i<fromLayout.totLength(); ++i){
+		auto it = fromLayout[i];
+		vol_t curSize = it.range.size();
+		if(curSize <= 0) continue;
+		if(rec) rec->flows.push_back({Traffic::Kind::TO_MEM, i, {0, 0}, curSize, &fromLayout});
+		unicast(it.tile, memLayout[i].tile, curSize);
+		tot_DRAM_acc += curSize;
+		if(!dram_port_bw.empty()) add_port_acc(dram_idx(memLayout[i].tile), curSize);
+	}
+}
+
+void NoC::fromRemoteMem(const MemULayout& memLayout, const DataLayout& toLayout, len_t fromCOffset, len_t fromB, len_t toB){
+	hop_t h = 0;
+	access_t acc = 0;
+
+	bool diffB = (fromB != toB);
+	auto rLen = toLayout.rangeLength();
+
+	for(cidx_t i=0; i<rLen; ++i){
+		auto toEntry = toLayout.at(i);
+		fmap_range toRange = toEntry.range;
+
+		if(toRange.c.to <= fromCOffset) continue;
+		toRange.c -= fromCOffset;
+
+		for(auto it = memLayout.getOfmL().get_intersect(toRange, diffB); it.isValid(); it.next()){
+			auto fromEntry = *it;
+			vol_t v = calc_intersect(fromEntry.range, toRange, fromB, toB);
+			if(v == 0) continue;
+			std::size_t port = nearest_dram_idx(fromEntry.tile);
+			const pos_t& dram = dram_list[port];
+			if(!dram_port_bw.empty()) add_port_acc(port, v);
+			if(rec) rec->flows.push_back({Traffic::Kind::FROM_MEM, i, dram, v, &toLayout});
+
+			if(toEntry.numTile == 1){
+				h += unicastCalc(dram, *toEntry.tiles, v);
+			}else{
+				h += multicastCalc(dram, toEntry.tiles, toEntry.numTile, v);
+			}
+			acc += v;
+		}
+	}
+
+	tot_hops += h;
+	tot_DRAM_acc += acc;
+}
+
 void NoC::betweenLayout(const UniqueLayout& fromLayout, const DataLayout& toLayout, len_t fromCOffset, len_t fromB, len_t toB){
 	hop_t h = 0;
 
@@ -159,6 +421,7 @@ void NoC::betweenLayout(const UniqueLayout& fromLayout, const DataLayout& toLayo
 			auto fromEntry = *it;
 			vol_t v = calc_intersect(fromEntry.range, toRange, fromB, toB);
 			if(v == 0) continue;
+			if(rec) rec->flows.push_back({Traffic::Kind::BETWEEN, i, fromEntry.tile, v, &toLayout});
 
 			if(toEntry.numTile == 1){
 				h += unicastCalc(fromEntry.tile, *toEntry.tiles, v);
@@ -172,37 +435,28 @@ void NoC::betweenLayout(const UniqueLayout& fromLayout, const DataLayout& toLayo
 }
 
 std::ostream& operator<<(std::ostream& os, const NoC& noc){
-	return os << "NoC(hops=" << noc.tot_hops << ", DRAM acc=" << noc.tot_DRAM_acc << ")";
+	static const char* const routings[] = {"XY", "YX", "O1TURN", "ADAPTIVE"};
+	os << "NoC(hops=" << noc.tot_hops << ", DRAM acc=" << noc.tot_DRAM_acc;
+	if(noc.routing != NoC::Routing::XY) os << ", " << routings[static_cast<int>(noc.routing)];
+	if(NoC::steiner) os << ", Steiner";
+	return os << ")";
 }
 
 std::vector<NoC::link_info> NoC::get_link_info() const{
 	std::vector<link_info> info;
 	if(!calc_bw) return info;
 
-	info.reserve(link_hops.link_hops.size());
-	for(const auto& it: link_hops.link_hops){
+	link_hops.flush();
+	const auto& hops = link_hops.link_hops;
+	for(HopCount::linkIdx_t i = 0; i < static_cast<HopCount::linkIdx_t>(hops.size()); ++i){
+		if(hops[i] == 0) continue;
 		mlen_t x, y, dir;
-		HopCount::get_dir(it.first, x, y, dir);
+		HopCount::get_dir(i, x, y, dir);
 
-		pos_t to;
-		switch(dir){
-		case 0:
-			to = {static_cast<mlen_t>(x+1), y};
-			break;
-		case 1:
-			to = {x, static_cast<mlen_t>(y-1)};
-			break;
-		case 2:
-			to = {static_cast<mlen_t>(x-1), y};
-			break;
-		case 3:
-			to = {x, static_cast<mlen_t>(y+1)};
-			break;
-		default:
-			assert(false);
-		}
+		pos_t to = Topology::link_to(x, y, dir);
 
-		info.push_back({{x, y}, to, it.second * link_hops.factor});
+		const bool d2d = Topology::has_d2d() && Topology::is_d2d(i);
+		info.push_back({{x, y}, to, hops[i] * link_hops.factor, dir, d2d});
 	}
 
 	// Sort in descending order.
@@ -215,21 +469,167 @@ void NoC::unicast(pos_t src, pos_t dst, vol_t size){
 	tot_hops += unicastCalc(src, dst, size);
 }
 
+/*
+ * Visits a straight path of |delta| links from *from* along x (or y),
+ * to direction E/S if delta > 0 (otherwise W/N), and returns #hops.
+ *
+ * fLine(dir, fwd, lo, hi) is called for the local links at positions
+ * [lo, hi] (in the row/column of *from*), and fLink(idx) for each express
+ * link. Express links are only used if *useExpress*, since a multicast
+ * needs to stop at each core on its path.
+ */
+template<typename FLine, typename FLink>
+static NoC::hop_t forLine(pos_t from, bool alongX, int delta, bool useExpress, FLine&& fLine, FLink&& fLink){
+	if(delta == 0) return 0;
+	const mlen_t len = alongX ? Cluster::xlen : Cluster::ylen;
+	const bool fwd = (delta > 0);
+	const int p = alongX ? from.x : from.y;
+	const int q = p + delta;
+
+	// Local links to e0 (e1), express links to e1 (e0), then local links to q.
+	int e0, e1;
+	if(useExpress && q >= 0 && q < len && Topology::express_span(MIN(p, q), MAX(p, q), e0, e1)){
+		const int step = fwd ? Topology::express : -Topology::express;
+		const int first = fwd ? e0 : e1, last = fwd ? e1 : e0;
+		const mlen_t dir = (alongX ? (fwd ? 0 : 2) : (fwd ? 3 : 1)) + 4;
+
+		NoC::hop_t h = forLine(from, alongX, first - p, false, fLine, fLink);
+		pos_t cur = from;
+		mlen_t& c = alongX ? cur.x : cur.y;
+		for(int e = first; e != last; e += step){
+			c = static_cast<mlen_t>(e);
+			fLink(Topology::link_idx(cur.x, cur.y, dir));
+			++h;
+		}
+		c = static_cast<mlen_t>(last);
+		return h + forLine(cur, alongX, q - last, false, fLine, fLink);
+	}
+
+	const mlen_t dir = alongX ? (fwd ? 0 : 2) : (fwd ? 3 : 1);
+	const int n = std::abs(delta);
+
+	// Links at [lo, hi], in two parts when wrapping around (torus only).
+	int lo = fwd ? p : p - n + 1;
+	int hi = fwd ? p + n - 1 : p;
+	if(lo < 0){
+		fLine(dir, fwd, lo + len, len - 1);
+		fLine(dir, fwd, 0, hi);
+	}else if(hi >= len){
+		fLine(dir, fwd, lo, len - 1);
+		fLine(dir, fwd, 0, hi - len);
+	}else{
+		fLine(dir, fwd, lo, hi);
+	}
+	return n;
+}
+
+// Adds a straight path, see forLine.
+NoC::hop_t NoC::lineCalc(pos_t from, bool alongX, int delta, vol_t size, bool useExpress){
+	const mlen_t len = alongX ? Cluster::xlen : Cluster::ylen;
+	const mlen_t chip = alongX ? Topology::chiplet_x : Topology::chiplet_y;
+	return forLine(from, alongX, delta, useExpress,
+		[&](mlen_t dir, bool fwd, int lo, int hi){
+			if(Topology::has_d2d()) tot_d2d_hops += Topology::count_d2d(lo, hi, fwd, len, chip) * size;
+			if(calc_bw) link_hops.add_line(from, dir, lo, hi, size);
+		},
+		[&](HopCount::linkIdx_t idx){
+			if(Topology::has_d2d() && Topology::is_d2d(idx)) tot_d2d_hops += size;
+			if(calc_bw) link_hops.add(idx, size);
+		});
+}
+
+NoC::hop_t NoC::routeCalc(pos_t src, pos_t dst, vol_t size, bool xFirst){
+	const int dx = Topology::offset(src.x, dst.x, Cluster::xlen);
+	const int dy = Topology::offset(src.y, dst.y, Cluster::ylen);
+	if(xFirst){
+		return lineCalc(src, true, dx, size, true) + lineCalc({dst.x, src.y}, false, dy, size, true);
+	}
+	return lineCalc(src, false, dy, size, true) + lineCalc({src.x, dst.y}, true, dx, size, true);
+}
+
+NoC::hop_t NoC::routeMax(pos_t src, pos_t dst, bool xFirst) const{
+	hop_t m = 0;
+	auto visit = [&](pos_t from, bool alongX, int delta){
+		forLine(from, alongX, delta, true,
+			[&](mlen_t dir, bool, int lo, int hi){
+				m = MAX(m, link_hops.line_max(from, dir, lo, hi));
+			},
+			[&](HopCount::linkIdx_t idx){
+				m = MAX(m, link_hops.get(idx));
+			});
+	};
+	const int dx = Topology::offset(src.x, dst.x, Cluster::xlen);
+	const int dy = Topology::offset(src.y, dst.y, Cluster::ylen);
+	if(xFirst){
+		visit(src, true, dx);
+		visit({dst.x, src.y}, false, dy);
+	}else{
+		visit(src, false, dy);
+		visit({src.x, dst.y}, true, dx);
+	}
+	return m;
+}
+
 NoC::hop_t NoC::unicastCalc(pos_t src, pos_t dst, vol_t size){
 	link_hops.flat_factor();
-	if(calc_bw){
-		size_t x_dir = (dst.x > src.x)?0:2;
-		size_t y_dir = (dst.y > src.y)?3:1;
-		mlen_t dx = (dst.x > src.x)?1:-1;
-		mlen_t dy = (dst.y > src.y)?1:-1;
-		for(mlen_t x = src.x; x != dst.x; x+= dx){
-			link_hops.get(x, src.y, x_dir) += size;
-		}
-		for(mlen_t y = src.y; y != dst.y; y+= dy){
-			link_hops.get(dst.x, y, y_dir) += size;
+	if(!calc_bw && Topology::is_mesh()){
+		return static_cast<hop_t>(abs(src.x-dst.x)+abs(src.y-dst.y)) * size;
+	}
+	// Routings only differ in the hops on each link.
+	if(!calc_bw || routing == Routing::XY || src.x == dst.x || src.y == dst.y){
+		return routeCalc(src, dst, size, true) * size;
+	}
+	switch(routing){
+	case Routing::YX:
+		return routeCalc(src, dst, size, false) * size;
+	case Routing::O1TURN:{
+		const vol_t half = size / 2;
+		hop_t h = routeCalc(src, dst, size - half, true);
+		if(half > 0) routeCalc(src, dst, half, false);
+		return h * size;
+	}
+	case Routing::ADAPTIVE:{
+		const bool xFirst = routeMax(src, dst, true) <= routeMax(src, dst, false);
+		return routeCalc(src, dst, size, xFirst) * size;
+	}
+	default:
+		assert(false);
+		return 0;
+	}
+}
+
+/*
+ * Minimal *back* and *fwd* such that [src-back, src+fwd] covers pos[0, n),
+ * which is sorted in a mesh (and the range can wrap around on a torus).
+ */
+static void cover(int src, const int* pos, cidx_t n, mlen_t len, int& back, int& fwd){
+	if(!Topology::torus){
+		back = MAX(src - pos[0], 0);
+		fwd = MAX(pos[n-1] - src, 0);
+		return;
+	}
+
+	// Offsets of all positions after src, in [0, len).
+	static thread_local std::vector<int> offs;
+	offs.resize(n);
+	for(cidx_t i = 0; i < n; ++i) offs[i] = (pos[i] - src + len) % len;
+	std::sort(offs.begin(), offs.end());
+
+	// Forward to offs[i], and backward to offs[i+1].
+	back = 0;
+	fwd = offs[n-1];
+	for(cidx_t i = 0; i + 1 < n; ++i){
+		if(offs[i] == offs[i+1]) continue;
+		int curBack = len - offs[i+1];
+		if(offs[i] + curBack < back + fwd){
+			back = curBack;
+			fwd = offs[i];
 		}
 	}
-	return static_cast<hop_t>(abs(src.x-dst.x)+abs(src.y-dst.y)) * size;
+	if(offs[0] > 0 && len - offs[0] < back + fwd){
+		back = len - offs[0];
+		fwd = 0;
+	}
 }
 
 void NoC::multicast(pos_t src, const pos_t* dst, cidx_t len, vol_t size){
@@ -252,55 +652,262 @@ void NoC::multicast(pos_t src, const pos_t* dst, cidx_t len, vol_t size){
  *     We need to iterate through all possible value of `a`.
  */
 NoC::hop_t NoC::multicastCalc(pos_t src, const pos_t* dst, cidx_t len, vol_t size){
+	if(steiner) return steinerCalc(src, dst, len, size);
 	link_hops.flat_factor();
 
 	mlen_t cur_x = dst[0].x;
 	mlen_t min_y = dst[0].y;
 	hop_t h = 0;
 
-	// First part, calculate x-direction hops
-
-	if(calc_bw){
-		for(mlen_t x = src.x; x > dst[0].x; --x){
-			link_hops.get(x, src.y, 2) += size;
-		}
-		for(mlen_t x = src.x; x < dst[len-1].x; ++x){
-			link_hops.get(x, src.y, 0) += size;
+	if(!calc_bw && Topology::is_mesh()){
+		// Fast path of the code below.
+		h += MAX(src.x, dst[len-1].x) - MIN(src.x, dst[0].x);
+		for(cidx_t i=1; i<=len; ++i){
+			if(i<len && dst[i].x == cur_x) continue;
+			h += MAX(src.y, dst[i-1].y) - MIN(src.y, min_y);
+			if(i == len) break;
+			cur_x = dst[i].x;
+			min_y = dst[i].y;
 		}
+		return h * size;
 	}
-	h += MAX(src.x, dst[len-1].x) - MIN(src.x, dst[0].x);
+
+	static thread_local std::vector<int> pos;
+	pos.resize(len);
+	int back, fwd;
+
+	// First part, calculate x-direction hops
+
+	for(cidx_t i=0; i<len; ++i) pos[i] = dst[i].x;
+	cover(src.x, pos.data(), len, Cluster::xlen, back, fwd);
+	h += lineCalc(src, true, -back, size, false);
+	h += lineCalc(src, true, fwd, size, false);
 
 	/* Second part, calculate y-direction hops
 	 * cur_x records the current x coordinate
-	 * min_y records the minimal y cooordinate of all dests with `x = cur_x`
-	 * 
+	 * first records the first dest with `x = cur_x`
+	 *
 	 * Notice that we must calculate at the end (when i=len)
 	 */
+	cidx_t first = 0;
 	for(cidx_t i=1; i<=len; ++i){
 		// If still at the same x coordinate, pass
 		if(i<len && dst[i].x == cur_x) continue;
 
 		// x coordinate changes, calculate hops of all previous dests with `x = cur_x`
 
-		if(calc_bw){
-			for(mlen_t y = src.y; y > min_y; --y){
-				link_hops.get(cur_x, y, 1) += size;
-			}
-			for(mlen_t y = src.y; y < dst[i-1].y; ++y){
-				link_hops.get(cur_x, y, 3) += size;
-			}
-		}
-		h += MAX(src.y, dst[i-1].y) - MIN(src.y, min_y);
+		for(cidx_t j=first; j<i; ++j) pos[j-first] = dst[j].y;
+		cover(src.y, pos.data(), i-first, Cluster::ylen, back, fwd);
+		h += lineCalc({cur_x, src.y}, false, -back, size, false);
+		h += lineCalc({cur_x, src.y}, false, fwd, size, false);
 		if(i == len) break;
 
-		// Update cur_x and min_y to the new dest
+		// Update cur_x and first to the new dest
 
 		cur_x = dst[i].x;
-		min_y = dst[i].y;
+		first = i;
 	}
 	return h * size;
 }
 
+/*
+ * Visits the trunk tree from src to dst[0, len), where dst is sorted by
+ * the coordinate along the trunk (x for a row trunk, y for a column trunk).
+ *
+ * With a row trunk at y = t, data goes from src along its column to the
+ * trunk (and to the dests in this column), along the trunk to all columns
+ * with dests, then along each column to its dests. A column trunk is the
+ * same with x and y swapped. The XY tree is the row trunk at t = src.y.
+ *
+ * f(from, alongX, delta) is called for each straight path (see forLine),
+ * which never takes express links.
+ */
+template<typename F>
+static void forTrunkTree(pos_t src, const pos_t* dst, cidx_t len, bool rowTrunk, int t, F&& f){
+	auto along = [=](pos_t p) -> int{ return rowTrunk ? p.x : p.y; };
+	auto across = [=](pos_t p) -> int{ return rowTrunk ? p.y : p.x; };
+	auto make = [=](int a, int b) -> pos_t{
+		return rowTrunk ? pos_t{static_cast<mlen_t>(a), static_cast<mlen_t>(b)}
+						: pos_t{static_cast<mlen_t>(b), static_cast<mlen_t>(a)};
+	};
+	const mlen_t alongLen = rowTrunk ? Cluster::xlen : Cluster::ylen;
+	const mlen_t acrossLen = rowTrunk ? Cluster::ylen : Cluster::xlen;
+	const int srcA = along(src), srcB = across(src);
+
+	static thread_local std::vector<int> pos;
+	pos.resize(len + 1);
+	int back, fwd;
+
+	// The trunk.
+	for(cidx_t i = 0; i < len; ++i) pos[i] = along(dst[i]);
+	cover(srcA, pos.data(), len, alongLen, back, fwd);
+	f(make(srcA, t), rowTrunk, -back);
+	f(make(srcA, t), rowTrunk, fwd);
+
+	// Branches of each column (row), the branch of src also goes to the trunk.
+	bool srcDone = false;
+	cidx_t first = 0;
+	for(cidx_t i = 1; i <= len; ++i){
+		if(i < len && along(dst[i]) == along(dst[first])) continue;
+		const int cur = along(dst[first]);
+		cidx_t n = 0;
+		for(cidx_t j = first; j < i; ++j) pos[n++] = across(dst[j]);
+		if(cur == srcA){
+			// Inserts t in order.
+			cidx_t k = n++;
+			for(; k > 0 && pos[k-1] > t; --k) pos[k] = pos[k-1];
+			pos[k] = t;
+			cover(srcB, pos.data(), n, acrossLen, back, fwd);
+			f(src, !rowTrunk, -back);
+			f(src, !rowTrunk, fwd);
+			srcDone = true;
+		}else{
+			cover(t, pos.data(), n, acrossLen, back, fwd);
+			f(make(cur, t), !rowTrunk, -back);
+			f(make(cur, t), !rowTrunk, fwd);
+		}
+		first = i;
+	}
+	if(!srcDone){
+		pos[0] = t;
+		cover(srcB, pos.data(), 1, acrossLen, back, fwd);
+		f(src, !rowTrunk, -back);
+		f(src, !rowTrunk, fwd);
+	}
+}
+
+/*
+ * Multicast on the cheapest trunk tree (a rectilinear Steiner tree),
+ * among row trunks and column trunks at all rows/columns (only those
+ * between src and the dests without torus, the others are never cheaper).
+ *
+ * Trees with the same #hops are ordered by the max #hops on their links
+ * (only with calc_bw), then the XY tree first. The #hops of the chosen
+ * tree never exceeds the XY tree.
+ */
+NoC::hop_t NoC::steinerCalc(pos_t src, const pos_t* dst, cidx_t len, vol_t size){
+	link_hops.flat_factor();
+
+	// Dests sorted by y for column trunks, sorted when first used.
+	static thread_local std::vector<pos_t> dstY;
+	bool sortedY = false;
+	auto dests = [&](bool rowTrunk){
+		if(rowTrunk) return dst;
+		if(!sortedY){
+			dstY.assign(dst, dst + len);
+			std::sort(dstY.begin(), dstY.end(), [](const pos_t& a, const pos_t& b){
+				return (a.y < b.y) || (a.y == b.y && a.x < b.x);
+			});
+			sortedY = true;
+		}
+		return static_cast<const pos_t*>(dstY.data());
+	};
+
+	/*
+	 * Without torus, #hops of a row trunk at t is the trunk (same for all t),
+	 * plus MAX(t, hi) - MIN(t, lo) of each column with dests at [lo, hi],
+	 * where the column of src also covers src. Same for column trunks.
+	 */
+	struct Branch{
+		int lo, hi;
+	};
+	static thread_local std::vector<Branch> branches[2];
+	static thread_local std::vector<Branch> line;
+	int trunk[2], minT[2], maxT[2];
+	for(int r = 0; r < 2; ++r){
+		const bool rowTrunk = (r == 1);
+		const int srcA = rowTrunk ? src.x : src.y, srcB = rowTrunk ? src.y : src.x;
+		line.assign(rowTrunk ? Cluster::xlen : Cluster::ylen, {std::numeric_limits<int>::max(), -1});
+		line[srcA] = {srcB, srcB};
+		int minA = srcA, maxA = srcA;
+		for(cidx_t i = 0; i < len; ++i){
+			const int a = rowTrunk ? dst[i].x : dst[i].y, v = rowTrunk ? dst[i].y : dst[i].x;
+			minA = MIN(minA, a);
+			maxA = MAX(maxA, a);
+			line[a].lo = MIN(line[a].lo, v);
+			line[a].hi = MAX(line[a].hi, v);
+		}
+		trunk[r] = maxA - minA;
+		minT[r] = maxT[r] = srcB;
+		auto& b = branches[r];
+		b.clear();
+		for(int a = minA; a <= maxA; ++a){
+			if(line[a].hi < 0) continue;
+			b.push_back(line[a]);
+			minT[r] = MIN(minT[r], line[a].lo);
+			maxT[r] = MAX(maxT[r], line[a].hi);
+		}
+		if(Topology::torus){
+			minT[r] = 0;
+			maxT[r] = (rowTrunk ? Cluster::ylen : Cluster::xlen) - 1;
+		}
+	}
+
+	auto tree_hops = [&](bool rowTrunk, int t){
+		hop_t h = 0;
+		if(Topology::torus){
+			forTrunkTree(src, dests(rowTrunk), len, rowTrunk, t, [&](pos_t, bool, int delta){
+				h += std::abs(delta);
+			});
+			return h;
+		}
+		h = trunk[rowTrunk];
+		for(const Branch& b: branches[rowTrunk]) h += MAX(t, b.hi) - MIN(t, b.lo);
+		return h;
+	};
+	auto tree_max = [&](bool rowTrunk, int t){
+		hop_t m = 0;
+		forTrunkTree(src, dests(rowTrunk), len, rowTrunk, t, [&](pos_t from, bool alongX, int delta){
+			forLine(from, alongX, delta, false,
+				[&](mlen_t dir, bool, int lo, int hi){
+					m = MAX(m, link_hops.line_max(from, dir, lo, hi));
+				},
+				[](HopCount::linkIdx_t){});
+		});
+		return m;
+	};
+
+	// Starts from the XY tree, which is optimal if its #hops equals the
+	// half perimeter of the bounding box (without torus).
+	bool bestRow = true;
+	int bestT = src.y;
+	hop_t bestHops = tree_hops(true, bestT);
+	hop_t bestMax = 0;
+	bool hasMax = false;
+	const bool optimal = !Topology::torus && bestHops == static_cast<hop_t>(trunk[0] + trunk[1]);
+	for(int r = 1; r >= 0 && !optimal; --r){
+		const bool rowTrunk = (r == 1);
+		for(int t = minT[r]; t <= maxT[r]; ++t){
+			if(rowTrunk && t == src.y) continue;
+			hop_t h = tree_hops(rowTrunk, t);
+			if(h > bestHops) continue;
+			if(h == bestHops){
+				if(!calc_bw) continue;
+				if(!hasMax){
+					bestMax = tree_max(bestRow, bestT);
+					hasMax = true;
+				}
+				hop_t m = tree_max(rowTrunk, t);
+				if(m >= bestMax) continue;
+				bestMax = m;
+			}else{
+				hasMax = false;
+			}
+			bestRow = rowTrunk;
+			bestT = t;
+			bestHops = h;
+		}
+	}
+
+	if(!calc_bw && Topology::is_mesh()) return bestHops * size;
+	hop_t h = 0;
+	forTrunkTree(src, dests(bestRow), len, bestRow, bestT, [&](pos_t from, bool alongX, int delta){
+		h += lineCalc(from, alongX, delta, size, false);
+	});
+	assert(h == bestHops);
+	return h * size;
+}
+
 void NoC::unicast_from_dram(pos_t dst, vol_t size){
 	size_t llen = dram_list.size();
 	size_t i = 0;
@@ -308,6 +915,7 @@ void NoC::unicast_from_dram(pos_t dst, vol_t size){
 	for(const pos_t& dram: dram_list){
 		vol_t to_size = (size * ++i) / llen;
 		unicast(dram, dst, to_size - from_size);
+		if(!dram_port_bw.empty()) add_port_acc(i-1, to_size - from_size);
 		from_size = to_size;
 	}
 	tot_DRAM_acc += size;
@@ -320,6 +928,7 @@ void NoC::unicast_to_dram(pos_t src, vol_t size){
 	for(const pos_t& dram: dram_list){
 		vol_t to_size = (size * ++i) / llen;
 		unicast(src, dram, to_size - from_size);
+		if(!dram_port_bw.empty()) add_port_acc(i-1, to_size - from_size);
 		from_size = to_size;
 	}
 	tot_DRAM_acc += size;
@@ -332,36 +941,42 @@ void NoC::multicast_from_dram(const pos_t* dst, cidx_t len, vol_t size){
 	for(const pos_t& dram: dram_list){
 		vol_t to_size = (size * ++i) / llen;
 		multicast(dram, dst, len, to_size - from_size);
+		if(!dram_port_bw.empty()) add_port_acc(i-1, to_size - from_size);
 		from_size = to_size;
 	}
 	tot_DRAM_acc += size;
 }
 
+/*
+ * Length of [from, to) covered by ranges [st + k*period, ed + k*period)
+ * for all k >= 0, where ed - st <= period (the ranges are disjoint).
+ *
+ * Covered length in [0, x) is k*(ed-st) + MIN(r, ed-st),
+ * with x - st = k*period + r (or 0 if x <= st).
+ */
+static len_t periodic_overlap(len_t st, len_t ed, len_t period, len_t from, len_t to){
+	assert(ed - st <= period);
+	const len_t len = ed - st;
+	auto covered = [=](len_t x) -> len_t{
+		if(x <= st) return 0;
+		len_t k = (x - st) / period, r = (x - st) % period;
+		return k * len + MIN(r, len);
+	};
+	return covered(to) - covered(from);
+}
+
 vol_t NoC::calc_intersect(const fmap_range& rng1, const fmap_range& rng2, len_t bat1, len_t bat2){
 	fmap_range ints = rng1.intersect(rng2);
 	if(bat1 == bat2) return ints.size();
 
-	len_t sb_st, sb_ed, lb_st, lb_ed, tot_b=0;
+	// The range with smaller batch size repeats in each of its batch groups.
+	len_t tot_b;
 	if(bat1 > bat2){
 		assert(bat1 % bat2 == 0);
-		sb_st = rng2.b.from;
-		sb_ed = rng2.b.to;
-		lb_st = rng1.b.from;
-		lb_ed = rng1.b.to;
-		for(;sb_st < lb_ed; sb_st+=bat2, sb_ed+=bat2){
-			if(sb_ed <= lb_st) continue;
-			tot_b += MIN(sb_ed, lb_ed) - MAX(sb_st, lb_st);
-		}
+		tot_b = periodic_overlap(rng2.b.from, rng2.b.to, bat2, rng1.b.from, rng1.b.to);
 	}else{
 		assert(bat2 % bat1 == 0);
-		sb_st = rng1.b.from;
-		sb_ed = rng1.b.to;
-		lb_st = rng2.b.from;
-		lb_ed = rng2.b.to;
-		for(;sb_st < lb_ed; sb_st+=bat1, sb_ed+=bat1){
-			if(sb_ed <= lb_st) continue;
-			tot_b += MIN(sb_ed, lb_ed) - MAX(sb_st, lb_st);
-		}
+		tot_b = periodic_overlap(rng1.b.from, rng1.b.to, bat1, rng2.b.from, rng2.b.to);
 	}
 	ints.b.from=0;
 	ints.b.to=tot_b;
@@ -373,12 +988,33 @@ vol_t NoC::calc_intersect(const fmap_range& rng1, const fmap_range& rng2, len_t
 }
 
 
-NoC::HopCount::HopCount():factor(1){}
+NoC::HopCount::HopCount():pending(false), factor(1){}
 
 NoC::HopCount& NoC::HopCount::operator+=(const HopCount& other){
+	if(other.link_hops.empty()) return *this;
+	if(link_hops.empty()){
+		link_hops = other.link_hops;
+		line_diff = other.line_diff;
+		pending = other.pending;
+		factor = other.factor;
+		return *this;
+	}
 	flat_factor();
-	for(const auto& it : other.link_hops){
-		link_hops[it.first] += it.second * other.factor;
+	// Both arrays are linear, so pending hops are added without flush().
+	const hop_t f = other.factor;
+	const std::size_t len = link_hops.size();
+	const hop_t* src = other.link_hops.data();
+	hop_t* dst = link_hops.data();
+	for(std::size_t i = 0; i < len; ++i){
+		dst[i] += src[i] * f;
+	}
+	if(other.pending){
+		src = other.line_diff.data();
+		dst = line_diff.data();
+		for(std::size_t i = 0; i < len; ++i){
+			dst[i] += src[i] * f;
+		}
+		pending = true;
 	}
 	return *this;
 }
@@ -391,16 +1027,20 @@ NoC::HopCount& NoC::HopCount::operator*=(const len_t& batch){
 NoC::HopCount& NoC::HopCount::operator/=(const len_t& batch){
 	if(factor % batch == 0){
 		factor /= batch;
-	}else if(factor == 1){
-		for(const auto& it: link_hops){
-			assert(it.second % batch == 0);
-			link_hops[it.first] = it.second / batch;
+		return *this;
+	}
+	// Division (with rounding) is not linear, thus flushed first.
+	flush();
+	if(factor == 1){
+		for(hop_t& h: link_hops){
+			assert(h % batch == 0);
+			h /= batch;
 		}
 	}else{
-		for(const auto& it: link_hops){
-			auto val = it.second * factor;
-			assert(val % batch == 0);
-			link_hops[it.first] = val / batch;
+		for(hop_t& h: link_hops){
+			h *= factor;
+			assert(h % batch == 0);
+			h /= batch;
 		}
 		factor = 1;
 	}
@@ -410,72 +1050,157 @@ NoC::HopCount& NoC::HopCount::operator/=(const len_t& batch){
 void NoC::HopCount::div(len_t batch){
 	if(factor % batch == 0){
 		factor /= batch;
-	}else if(factor == 1){
-		for(const auto& it: link_hops){
-			// assert(it.second % batch == 0);
-			link_hops[it.first] = it.second / batch;
+		return;
+	}
+	// Division (with rounding) is not linear, thus flushed first.
+	flush();
+	if(factor == 1){
+		for(hop_t& h: link_hops){
+			// assert(h % batch == 0);
+			h /= batch;
 		}
 	}else{
-		for(const auto& it: link_hops){
-			auto val = it.second * factor;
-			// assert(val % batch == 0);
-			link_hops[it.first] = val / batch;
+		for(hop_t& h: link_hops){
+			h *= factor;
+			// assert(h % batch == 0);
+			h /= batch;
 		}
 		factor = 1;
 	}
 }
 
+void NoC::HopCount::max(hop_t& local, hop_t& d2d) const{
+	flush();
+	local = d2d = 0;
+	for(linkIdx_t i = 0; i < static_cast<linkIdx_t>(link_hops.size()); ++i){
+		hop_t& h = Topology::is_d2d(i) ? d2d : local;
+		h = MAX(h, link_hops[i]);
+	}
+	local *= factor;
+	d2d *= factor;
+}
+
+NoC::hop_t NoC::HopCount::get(linkIdx_t idx) const{
+	if(link_hops.empty()) return 0;
+	flush();
+	return link_hops[idx] * factor;
+}
+
+NoC::hop_t NoC::HopCount::line_max(pos_t pos, mlen_t dir, int from, int to) const{
+	if(link_hops.empty()) return 0;
+	flush();
+	const bool alongX = (dir % 2 == 0);
+	hop_t m = 0;
+	for(int i = from; i <= to; ++i){
+		const mlen_t c = static_cast<mlen_t>(i);
+		m = MAX(m, link_hops[alongX ? get_idx(c, pos.y, dir) : get_idx(pos.x, c, dir)]);
+	}
+	return m * factor;
+}
+
 NoC::hop_t NoC::HopCount::max() const{
+	flush();
 	hop_t h = 0;
-	for(const auto& it: link_hops){
-		h = MAX(h, it.second);
+	for(hop_t cur: link_hops){
+		h = MAX(h, cur);
 	}
 	return h * factor;
 }
 
-NoC::hop_t& NoC::HopCount::get(mlen_t x, mlen_t y, mlen_t dir){
+void NoC::HopCount::alloc(){
+	if(link_hops.empty()){
+		link_hops.assign(num_links(), 0);
+		line_diff.assign(num_links(), 0);
+	}
+}
+
+void NoC::HopCount::add(linkIdx_t idx, hop_t size){
 	assert(factor == 1);
-	linkIdx_t idx = get_idx(x, y, dir);
-	return link_hops[idx];
+	alloc();
+	link_hops[idx] += size;
+}
+
+void NoC::HopCount::add_line(pos_t pos, mlen_t dir, int from, int to, hop_t size){
+	assert(factor == 1 && dir < 4);
+	alloc();
+	pending = true;
+
+	// Links [from, to] along x (dir 0/2) or y (dir 1/3).
+	const bool alongX = (dir % 2 == 0);
+	mlen_t& cur = alongX ? pos.x : pos.y;
+	const int dimLen = alongX ? Cluster::xlen : Cluster::ylen;
+	assert(from >= 0 && from <= to && to < dimLen);
+
+	cur = static_cast<mlen_t>(from);
+	line_diff[get_idx(pos.x, pos.y, dir)] += size;
+	if(to + 1 < dimLen){
+		cur = static_cast<mlen_t>(to + 1);
+		line_diff[get_idx(pos.x, pos.y, dir)] -= size;
+	}
+}
+
+void NoC::HopCount::flush() const{
+	if(!pending) return;
+	pending = false;
+
+	const linkIdx_t dirs = Topology::num_dirs();
+	const linkIdx_t xStep = dirs * Cluster::ylen;
+	const linkIdx_t total = num_links();
+	// E/W links: prefix sums along x (stride xStep), express links are never pending.
+	for(linkIdx_t i = 0; i < xStep; ++i){
+		if(i % dirs != 0 && i % dirs != 2) continue;
+		hop_t sum = 0;
+		for(linkIdx_t j = i; j < total; j += xStep){
+			sum += line_diff[j];
+			line_diff[j] = 0;
+			link_hops[j] += sum;
+		}
+	}
+	// N/S links: prefix sums along y (stride dirs).
+	for(linkIdx_t i = 0; i < total; i += xStep){
+		for(linkIdx_t dir = 1; dir < 4; dir += 2){
+			hop_t sum = 0;
+			for(linkIdx_t j = i + dir; j < i + xStep; j += dirs){
+				sum += line_diff[j];
+				line_diff[j] = 0;
+				link_hops[j] += sum;
+			}
+		}
+	}
+}
+
+NoC::HopCount::linkIdx_t NoC::HopCount::num_links(){
+	return Topology::num_links();
 }
 
 NoC::HopCount::linkIdx_t NoC::HopCount::get_idx(mlen_t x, mlen_t y, mlen_t dir){
 	static_assert(sizeof(linkIdx_t) > 2 * sizeof(mlen_t), "linkIdx_t needs to store x, y and dir");
 
-	linkIdx_t idx = (static_cast<linkIdx_t>(x) * Cluster::ylen + y) * 4 + dir;
-	assert(idx < static_cast<linkIdx_t>(4)*Cluster::xlen*Cluster::ylen);
+	linkIdx_t idx = Topology::link_idx(x, y, dir);
+	assert(idx >= 0 && idx < num_links());
 	return idx;
 }
 
 void NoC::HopCount::get_dir(linkIdx_t link_idx, mlen_t& x, mlen_t& y, mlen_t& dir){
-	// Notice: need to deal with negative x and y.
-
-	dir = link_idx % 4;
-	link_idx /= 4;
-	if(dir < 0){
-		link_idx -= 1;
-		dir += 4;
-	}
-
-	y = link_idx % Cluster::ylen;
-	link_idx /= Cluster::ylen;
-	if(y < 0){
-		link_idx -= 1;
-		y += Cluster::ylen;
-	}
-
-	x = link_idx;
+	Topology::link_pos(link_idx, x, y, dir);
 }
 
 void NoC::HopCount::clear(){
 	factor = 1;
 	link_hops.clear();
+	line_diff.clear();
+	pending = false;
 }
 
 void NoC::HopCount::flat_factor(){
 	if(factor > 1){
-		for(const auto& it: link_hops){
-			link_hops[it.first] *= factor;
+		for(hop_t& h: link_hops){
+			h *= factor;
+		}
+		if(pending){
+			for(hop_t& h: line_diff){
+				h *= factor;
+			}
 		}
 		factor = 1;
 	}
@@ -485,17 +1210,19 @@ void NoC::HopCount::flat_factor(){
 bool NoC::link_info::operator<(const link_info& other) const{
 	if(total_hops != other.total_hops) return total_hops < other.total_hops;
 	if(from != other.from) return from < other.from;
-	return to < other.to;
+	if(to != other.to) return to < other.to;
+	return dir < other.dir;
 }
 
 bool NoC::link_info::operator==(const link_info& other) const{
-	return total_hops == other.total_hops && from == other.from && to == other.to;
+	return total_hops == other.total_hops && from == other.from && to == other.to && dir == other.dir;
 }
 
 bool NoC::link_info::operator>(const link_info& other) const{
 	if(total_hops != other.total_hops) return total_hops > other.total_hops;
 	if(from != other.from) return from > other.from;
-	return to > other.to;
+	if(to != other.to) return to > other.to;
+	return dir > other.dir;
 }
 
 std::ostream& operator<<(std::ostream& os, const NoC::link_info& info){
@@ -0,0 +1,446 @@
+#include "nocsim.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "cluster.h"
+#include "layerengine.h"
+#include "scheval.h"
+#include "topology.h"
+
+
+// A flow is done when less than FLOW_EPS of its data is left.
+static constexpr double FLOW_EPS = 1e-9;
+
+NoCSim::NoCSim(std::size_t _channels, std::size_t _num_buckets)
+	:channels(_channels), num_buckets(_num_buckets), now(0), width(1){
+	assert(num_buckets > 0);
+	const std::int32_t numLinks = Topology::num_links();
+	cap.resize(numLinks + NoC::dram_list.size());
+	for(std::int32_t i = 0; i < numLinks; ++i){
+		cap[i] = (Topology::has_d2d() && Topology::is_d2d(i)) ? Topology::d2d_bw : NoC::NoC_bw;
+	}
+	// Without dram_port_bw, all ports share DRAM_bw.
+	for(std::size_t i = 0; i < NoC::dram_list.size(); ++i){
+		cap[port_res(i)] = NoC::dram_port_bw.empty() ? static_cast<double>(NoC::DRAM_bw) / NoC::dram_list.size() : NoC::dram_port_bw[i];
+	}
+	reset();
+}
+
+void NoCSim::reset(){
+	flows.clear();
+	running.clear();
+	waiting.clear();
+	num_running.assign(cap.size(), 0);
+	usage.assign(cap.size(), 0);
+	added.assign(cap.size(), 0);
+	now = 0;
+	load.assign(cap.size() * num_buckets, 0);
+	width = 1;
+}
+
+std::int32_t NoCSim::port_res(std::size_t port){
+	return Topology::num_links() + static_cast<std::int32_t>(port);
+}
+
+void NoCSim::route(const NoC::Traffic::Transfer& transfer, NoC::Routing routing, res_list& res) const{
+	const auto len = static_cast<cidx_t>(transfer.dst.size());
+	if(routing != NoC::Routing::ADAPTIVE){
+		NoC::get_route(transfer.src, transfer.dst.data(), len, routing, res);
+	}else{
+		// The route with the smaller max load (ties go to XY).
+		res_list yx;
+		NoC::get_route(transfer.src, transfer.dst.data(), len, NoC::Routing::XY, res);
+		NoC::get_route(transfer.src, transfer.dst.data(), len, NoC::Routing::YX, yx);
+		auto max_load = [&](const res_list& r){
+			double m = 0;
+			for(const auto& p: r) m = MAX(m, added[p.first]);
+			return m;
+		};
+		if(max_load(yx) < max_load(res)) res.swap(yx);
+	}
+	if(transfer.port >= 0) res.emplace_back(port_res(transfer.port), 1.0);
+}
+
+std::size_t NoCSim::add_flow(const res_list& res, double size){
+	const std::size_t id = flows.size();
+	flows.push_back({res, size, size, 0, now, now});
+	for(const auto& p: res) added[p.first] += size * p.second;
+	if(res.empty() || size <= 0){
+		flows[id].left = 0;
+		return id;
+	}
+	flows[id].end = -1;
+	if(waiting.empty() && try_start(id)){
+		update_rates();
+	}else{
+		waiting.push_back(id);
+	}
+	return id;
+}
+
+std::size_t NoCSim::add_flow(const NoC::Traffic::Transfer& transfer, NoC::Routing routing){
+	res_list res;
+	route(transfer, routing, res);
+	return add_flow(res, transfer.size);
+}
+
+bool NoCSim::try_start(std::size_t id){
+	const res_list& res = flows[id].res;
+	if(channels > 0){
+		for(const auto& p: res){
+			if(num_running[p.first] >= channels) return false;
+		}
+	}
+	for(const auto& p: res) ++num_running[p.first];
+	running.push_back(id);
+	return true;
+}
+
+/*
+ * Max-min fairness by progressive filling: the rates of all unfrozen flows
+ * are increased together, until a resource is full. Then all flows on it
+ * are frozen, until all flows are frozen.
+ */
+void NoCSim::update_rates(){
+	const std::size_t numRes = cap.size();
+	static thread_local std::vector<double> left, wsum;
+	static thread_local std::vector<std::size_t> cnt;
+	static thread_local std::vector<char> frozen;
+	left = cap;
+	wsum.assign(numRes, 0);
+	cnt.assign(numRes, 0);
+	frozen.assign(running.size(), 0);
+
+	for(std::size_t id: running){
+		flows[id].rate = 0;
+		for(const auto& p: flows[id].res){
+			wsum[p.first] += p.second;
+			++cnt[p.first];
+		}
+	}
+
+	std::size_t numLeft = running.size();
+	while(numLeft > 0){
+		double inc = std::numeric_limits<double>::infinity();
+		for(std::size_t r = 0; r < numRes; ++r){
+			if(cnt[r] > 0) inc = MIN(inc, MAX(left[r], 0.0) / wsum[r]);
+		}
+		assert(inc < std::numeric_limits<double>::infinity());
+		for(std::size_t r = 0; r < numRes; ++r){
+			if(cnt[r] > 0) left[r] -= inc * wsum[r];
+		}
+		for(std::size_t k = 0; k < running.size(); ++k){
+			if(frozen[k]) continue;
+			Flow& f = flows[running[k]];
+			f.rate += inc;
+			bool full = false;
+			for(const auto& p: f.res){
+				if(cnt[p.first] > 0 && left[p.first] <= FLOW_EPS * cap[p.first]){
+					full = true;
+					break;
+				}
+			}
+			if(!full) continue;
+			frozen[k] = 1;
+			--numLeft;
+			for(const auto& p: f.res){
+				wsum[p.first] -= p.second;
+				--cnt[p.first];
+			}
+		}
+	}
+
+	for(std::size_t r = 0; r < numRes; ++r) usage[r] = cap[r] - MAX(left[r], 0.0);
+}
+
+void NoCSim::add_load(double dt){
+	const double end = now + dt;
+	// Merges buckets until [now, end) fits in them.
+	while(end > width * num_buckets){
+		for(std::size_t r = 0; r < cap.size(); ++r){
+			double* l = load.data() + r * num_buckets;
+			for(std::size_t b = 0; b < num_buckets; ++b){
+				l[b] = (2*b < num_buckets) ? l[2*b] + ((2*b+1 < num_buckets) ? l[2*b+1] : 0) : 0;
+			}
+		}
+		width *= 2;
+	}
+
+	const auto first = static_cast<std::size_t>(now / width);
+	const auto last = MIN(static_cast<std::size_t>(end / width), num_buckets - 1);
+	for(std::size_t r = 0; r < cap.size(); ++r){
+		if(usage[r] <= 0) continue;
+		double* l = load.data() + r * num_buckets;
+		for(std::size_t b = first; b <= last; ++b){
+			const double from = MAX(now, b * width), to = MIN(end, (b + 1) * width);
+			if(to > from) l[b] += usage[r] * (to - from);
+		}
+	}
+}
+
+bool NoCSim::step(std::vector<std::size_t>& done){
+	done.clear();
+	if(running.empty()) return false;
+
+	double dt = std::numeric_limits<double>::infinity();
+	for(std::size_t id: running) dt = MIN(dt, flows[id].left / flows[id].rate);
+	add_load(dt);
+	now += dt;
+
+	std::size_t n = 0;
+	for(std::size_t id: running){
+		Flow& f = flows[id];
+		f.left -= f.rate * dt;
+		if(f.left > FLOW_EPS * f.size){
+			running[n++] = id;
+			continue;
+		}
+		f.left = 0;
+		f.end = now;
+		for(const auto& p: f.res) --num_running[p.first];
+		done.push_back(id);
+	}
+	running.resize(n);
+	assert(!done.empty());
+
+	// Waiting flows start in order of arrival.
+	n = 0;
+	for(std::size_t id: waiting){
+		if(!try_start(id)) waiting[n++] = id;
+	}
+	waiting.resize(n);
+	update_rates();
+	return true;
+}
+
+void NoCSim::run(){
+	std::vector<std::size_t> done;
+	while(step(done));
+	assert(waiting.empty());
+}
+
+double NoCSim::get_time() const{
+	return now;
+}
+
+std::size_t NoCSim::num_flows() const{
+	return flows.size();
+}
+
+bool NoCSim::is_done(std::size_t id) const{
+	return flows[id].left <= 0;
+}
+
+double NoCSim::get_latency(std::size_t id) const{
+	return flows[id].end - flows[id].start;
+}
+
+// Prints resource *r* as a link "(x, y) -> (x, y) dir" or a DRAM port.
+static void print_res(std::ostream& os, std::int32_t r){
+	static const char* const names[] = {"E", "S", "W", "N", "xE", "xS", "xW", "xN"};
+	if(r >= Topology::num_links()){
+		os << "DRAM " << NoC::dram_list[r - Topology::num_links()];
+		return;
+	}
+	mlen_t x, y, dir;
+	Topology::link_pos(r, x, y, dir);
+	os << pos_t{x, y} << " -> " << Topology::link_to(x, y, dir) << ' ' << names[dir];
+	if(Topology::has_d2d() && Topology::is_d2d(r)) os << " (D2D)";
+}
+
+void NoCSim::print_stats(std::ostream& os, std::size_t top) const{
+	double sum = 0, max = 0;
+	for(std::size_t id = 0; id < flows.size(); ++id){
+		const double l = get_latency(id);
+		sum += l;
+		max = MAX(max, l);
+	}
+	os << "\tFlows: " << flows.size();
+	if(!flows.empty()) os << ", latency avg: " << sum / flows.size() << ", max: " << max;
+	os << std::endl;
+	if(now <= 0) return;
+
+	// Busiest resources, by their average occupancy.
+	std::vector<std::pair<double, std::int32_t>> busy;
+	for(std::size_t r = 0; r < cap.size(); ++r){
+		const double* l = load.data() + r * num_buckets;
+		double tot = 0;
+		for(std::size_t b = 0; b < num_buckets; ++b) tot += l[b];
+		if(tot > 0) busy.emplace_back(tot / (cap[r] * now), static_cast<std::int32_t>(r));
+	}
+	std::sort(busy.begin(), busy.end(), [](const std::pair<double, std::int32_t>& a, const std::pair<double, std::int32_t>& b){
+		return a.first > b.first;
+	});
+	if(busy.size() > top) busy.resize(top);
+	for(const auto& b: busy){
+		os << "\t\t";
+		print_res(os, b.second);
+		os << "\toccupancy: " << 100 * b.first << '%' << std::endl;
+	}
+}
+
+void NoCSim::print_header(std::ostream& os){
+	os << "label,kind,x,y,dir,start,end,load,occupancy" << std::endl;
+}
+
+void NoCSim::print_occupancy(std::ostream& os, const std::string& label) const{
+	const std::int32_t numLinks = Topology::num_links();
+	for(std::size_t r = 0; r < cap.size(); ++r){
+		const double* l = load.data() + r * num_buckets;
+		for(std::size_t b = 0; b < num_buckets; ++b){
+			if(l[b] <= 0) continue;
+			const double from = b * width, to = MIN((b + 1) * width, now);
+			os << label << ',';
+			if(static_cast<std::int32_t>(r) < numLinks){
+				mlen_t x, y, dir;
+				Topology::link_pos(static_cast<std::int32_t>(r), x, y, dir);
+				os << "link," << static_cast<int>(x) << ',' << static_cast<int>(y) << ',' << static_cast<int>(dir) << ',';
+			}else{
+				const pos_t& port = NoC::dram_list[r - numLinks];
+				os << "dram," << static_cast<int>(port.x) << ',' << static_cast<int>(port.y) << ",,";
+			}
+			os << from << ',' << to << ',' << l[b] << ',' << l[b] / (cap[r] * (to - from)) << std::endl;
+		}
+	}
+}
+
+void NoCSim::simulate(const SchEval& eval, const StdLayerEngine& engine, std::ostream& os, std::ostream& csv){
+	typedef SchEval::nid_t nid_t;
+	std::vector<len_t> repeat;
+	std::vector<long> segment;
+	eval.number_nodes(repeat, segment);
+
+	// Segments, or the root if there is none.
+	std::vector<nid_t> segs;
+	for(nid_t id = 0; id < eval.size(); ++id){
+		if(eval.is_seg(id) && eval.is_valid(id)) segs.push_back(id);
+	}
+	if(segs.empty() && eval.is_valid(eval.root())) segs.push_back(eval.root());
+
+	NoC::Traffic traffic;
+	std::vector<NoC::Traffic::Transfer> transfers;
+	// Adds the transfers of all layers in node "id", times "factor".
+	auto add_node = [&](auto&& self, nid_t id, len_t factor) -> void{
+		if(eval.get_type(id) == SchEval::NodeType::L){
+			const LNode* node = eval.get_lnode(id);
+			engine.record_traffic(node, traffic);
+			transfers.clear();
+			traffic.get_transfers(transfers);
+			const NoC::Routing routing = node->get_noc().get_routing();
+			for(auto& t: transfers){
+				t.size *= factor;
+				add_flow(t, routing);
+			}
+			return;
+		}
+		factor *= eval.get_num_bgrp(id);
+		for(const nid_t* c = eval.children_begin(id); c != eval.children_end(id); ++c){
+			self(self, *c, factor);
+		}
+	};
+
+	print_header(csv);
+	double totAnalytic = 0, totSim = 0;
+	for(nid_t id: segs){
+		reset();
+		add_node(add_node, id, 1);
+		run();
+
+		const NoC* noc = eval.get_noc(id);
+		const double analytic = (noc != nullptr) ? static_cast<double>(noc->get_time()) : 0;
+		totAnalytic += analytic * repeat[id];
+		totSim += now * repeat[id];
+
+		if(eval.is_seg(id)){
+			os << "[Segment " << segment[id] << "] ";
+		}else{
+			os << "[Total] ";
+		}
+		os << "repeat: " << repeat[id] << ", analytic NoC time: " << analytic << ", simulated: " << now;
+		if(analytic > 0) os << " (" << now / analytic << "x)";
+		os << std::endl;
+		print_stats(os);
+		print_occupancy(csv, std::to_string(segment[id]));
+	}
+	os << "[Total] analytic NoC time: " << totAnalytic << ", simulated: " << totSim;
+	if(totAnalytic > 0) os << " (" << totSim / totAnalytic << "x)";
+	os << std::endl;
+}
+
+void NoCSim::simulate(const ChipletTrace::FullTrace& trace, std::size_t max_sends, vol_t data_bytes, std::ostream& os, std::ostream& csv){
+	using ChipletTrace::OpType;
+	reset();
+
+	int first = 0;
+	while((NoC::routing_mask & (1 << first)) == 0) ++first;
+	const auto routing = static_cast<NoC::Routing>(first);
+
+	const std::size_t numChips = trace.chiplet_traces.size();
+	std::vector<pos_t> pos(numChips);
+	for(std::size_t i = 0; i < numChips; ++i){
+		pos[i] = {trace.chiplet_traces[i].pos_x, trace.chiplet_traces[i].pos_y};
+	}
+
+	// Next operation and #running sends of each chiplet.
+	std::vector<std::size_t> pc(numChips, 0), sends(numChips, 0);
+	// Flow of each transfer id, and the sender of each flow (or -1).
+	std::unordered_map<int, std::size_t> flowOf;
+	std::vector<long> sender;
+
+	auto start = [&](const ChipletTrace::Operation& op, pos_t src, pos_t dst, int port){
+		NoC::Traffic::Transfer t{src, {dst}, static_cast<double>(op.data_size) / data_bytes, port};
+		const std::size_t id = add_flow(t, routing);
+		flowOf[op.transfer_id] = id;
+		sender.resize(flows.size(), -1);
+		return id;
+	};
+
+	std::vector<std::size_t> done;
+	while(true){
+		bool finished = true;
+		for(std::size_t i = 0; i < numChips; ++i){
+			const auto& ops = trace.chiplet_traces[i].operations;
+			for(; pc[i] < ops.size(); ++pc[i]){
+				const auto& op = ops[pc[i]];
+				if(op.type == OpType::COMPUTE) continue;
+				if(op.type == OpType::SEND){
+					if(max_sends > 0 && sends[i] >= max_sends) break;
+					const std::size_t id = start(op, pos[i], pos[op.peer_id], -1);
+					if(!is_done(id)){
+						sender[id] = static_cast<long>(i);
+						++sends[i];
+					}
+					continue;
+				}
+				auto it = flowOf.find(op.transfer_id);
+				if(it == flowOf.end()){
+					if(op.peer_id >= 0) break;
+					// From the nearest DRAM port.
+					const std::size_t port = NoC::nearest_dram_idx(pos[i]);
+					start(op, NoC::dram_list[port], pos[i], static_cast<int>(port));
+					it = flowOf.find(op.transfer_id);
+				}
+				if(!is_done(it->second)) break;
+			}
+			if(pc[i] < ops.size()) finished = false;
+		}
+		if(finished) break;
+
+		if(!step(done)){
+			os << "[Error] Trace is blocked (unmatched RECV) at time " << now << std::endl;
+			break;
+		}
+		for(std::size_t id: done){
+			if(sender[id] >= 0) --sends[sender[id]];
+		}
+	}
+
+	os << "Trace: " << numChips << " chiplets, simulated NoC time: " << now << std::endl;
+	print_stats(os);
+	print_header(csv);
+	print_occupancy(csv, "trace");
+}
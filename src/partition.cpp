@@ -95,6 +95,11 @@ PartIter PartEngine::init(cidx_t cluster_size, len_t batch_num, const Node& laye
 	return it;
 }
 
+const std::vector<PartSch>& PartEngine::all_parts(cidx_t cluster_size){
+	assert(cluster_size <= MAX_BUF);
+	return factors[cluster_size];
+}
+
 bool PartIter::calcUtil(const PartSch& nextSch) const{
 	if(nextSch.B * nextSch.H * nextSch.W < min_ncut) return false;
 	double util = calc_util(maxK, nextSch.K)\
@@ -197,6 +202,10 @@ vol_t PartSch::size() const{
 	return K*B*H*W;
 }
 
+bool PartSch::operator==(const PartSch& other) const{
+	return K == other.K && B == other.B && H == other.H && W == other.W;
+}
+
 std::ostream& operator<<(std::ostream& os, const PartSch& sch){
 	return os << "(B=" << sch.B << ",K=" << sch.K << ",H=" << sch.H << ",W=" << sch.W << ')';
 }
@@ -3,14 +3,76 @@
 #include <algorithm>
 #include <cassert>
 #include <cstring>
+#include <unordered_map>
+#include <vector>
 
 #include "cluster.h"
 
 
 PlaceEngine placeEngine;
+std::uint8_t PlaceEngine::gen_mask = 1 << static_cast<int>(PlaceGen::ORDER);
+
+// Index of (x, y) on the Hilbert curve of an n*n mesh (n is a power of 2).
+static std::uint32_t hilbert_idx(std::uint32_t n, std::uint32_t x, std::uint32_t y){
+	std::uint32_t d = 0;
+	for(std::uint32_t s = n/2; s > 0; s /= 2){
+		std::uint32_t rx = (x & s) > 0;
+		std::uint32_t ry = (y & s) > 0;
+		d += s * s * ((3 * rx) ^ ry);
+		if(ry == 0){
+			if(rx == 1){
+				x = n-1-x;
+				y = n-1-y;
+			}
+			std::swap(x, y);
+		}
+	}
+	return d;
+}
+
+// Index of (x, y) on the Z-order curve (interleaved bits of x and y).
+static std::uint32_t zorder_idx(std::uint32_t x, std::uint32_t y){
+	std::uint32_t d = 0;
+	for(int i = 0; i < 8; ++i){
+		d |= ((x >> i) & 1u) << (2*i);
+		d |= ((y >> i) & 1u) << (2*i+1);
+	}
+	return d;
+}
+
+// Cores of *cluster* sorted along the curve of *gen*, cached in each thread.
+static const pos_t* curve_order(const Cluster& cluster, PlaceGen gen){
+	static thread_local std::unordered_map<std::uint64_t, std::vector<pos_t>> cache;
+
+	const cidx_t numCores = cluster.num_cores();
+	const pos_t first = cluster[0];
+	std::uint64_t key = static_cast<std::uint8_t>(first.x);
+	key = (key << 8) | static_cast<std::uint8_t>(first.y);
+	key = (key << 16) | static_cast<std::uint16_t>(numCores);
+	key = (key << 8) | static_cast<std::uint8_t>(gen);
+
+	auto& cores = cache[key];
+	if(!cores.empty()) return cores.data();
+
+	std::uint32_t n = 1;
+	while(n < static_cast<std::uint32_t>(MAX(Cluster::xlen, Cluster::ylen))) n *= 2;
+	std::vector<std::pair<std::uint32_t, pos_t>> keys(numCores);
+	for(cidx_t i = 0; i < numCores; ++i){
+		const pos_t pos = cluster[i];
+		const auto x = static_cast<std::uint32_t>(pos.x), y = static_cast<std::uint32_t>(pos.y);
+		keys[i].first = (gen == PlaceGen::HILBERT) ? hilbert_idx(n, x, y) : zorder_idx(x, y);
+		keys[i].second = pos;
+	}
+	std::sort(keys.begin(), keys.end(), [](const std::pair<std::uint32_t, pos_t>& a, const std::pair<std::uint32_t, pos_t>& b){
+		return a.first < b.first;
+	});
+	cores.resize(numCores);
+	for(cidx_t i = 0; i < numCores; ++i) cores[i] = keys[i].second;
+	return cores.data();
+}
 
 PlaceSch::PlaceSch(const PlaceSch& sch)
-	:part(sch.part),
+	:part(sch.part), gen(sch.gen),
 	 ifmLayout(sch.ifmLayout->clone()),
 	 wgtLayout(sch.wgtLayout->clone()),
 	 ofmLayout(sch.ofmLayout->clone())
@@ -42,23 +104,30 @@ const UniqueLayout& PlaceSch::getOfmL() const{
 	return *ofmLayout.get();
 }
 
-void PlaceSch::initPlacement(const Cluster& cluster){
+void PlaceSch::initPlacement(const Cluster& cluster, const pos_t* alignPos){
 	using plen_t = PartSch::partlen_t;
 
 	pos_t* curIdx = permuteOrder.get();
 
-	plen_t step[4] = {1,1,1,1};
-	step[order[3]] = 1;
-	step[order[2]] = part[order[3]];
-	step[order[1]] = part[order[3]] * part[order[2]];
-	step[order[0]] = part[order[3]] * part[order[2]] * part[order[1]];
-	for(plen_t k = 0; k < part.K; ++k){
-		for(plen_t b = 0; b < part.B; ++b){
-			for(plen_t h = 0; h < part.H; ++h){
-				for(plen_t w = 0; w < part.W; ++w){
-					// Init (b, k, h, w)
-					plen_t idx = step[0] * k + step[1] * b + step[2] * h + step[3] * w;
-					*(curIdx++) = cluster[idx];
+	if(gen == PlaceGen::ALIGN){
+		assert(alignPos != nullptr);
+		memcpy(curIdx, alignPos, sizeof(pos_t) * cluster.num_cores());
+	}else{
+		const pos_t* cores = (gen == PlaceGen::ORDER) ? nullptr : curve_order(cluster, gen);
+
+		plen_t step[4] = {1,1,1,1};
+		step[order[3]] = 1;
+		step[order[2]] = part[order[3]];
+		step[order[1]] = part[order[3]] * part[order[2]];
+		step[order[0]] = part[order[3]] * part[order[2]] * part[order[1]];
+		for(plen_t k = 0; k < part.K; ++k){
+			for(plen_t b = 0; b < part.B; ++b){
+				for(plen_t h = 0; h < part.H; ++h){
+					for(plen_t w = 0; w < part.W; ++w){
+						// Init (b, k, h, w)
+						plen_t idx = step[0] * k + step[1] * b + step[2] * h + step[3] * w;
+						*(curIdx++) = (cores == nullptr) ? cluster[idx] : cores[idx];
+					}
 				}
 			}
 		}
@@ -72,9 +141,24 @@ void PlaceSch::initPlacement(const Cluster& cluster){
 
 void PlaceSch::update(PlaceSch&& sch){
 	part = sch.part;
+	gen = sch.gen;
 	memcpy(order, sch.order, sizeof(order[0])*4);
 }
 
+bool PlaceSch::sameScheme(const PlaceSch& sch) const{
+	if(!(part == sch.part && gen == sch.gen && memcmp(order, sch.order, sizeof(order[0])*4) == 0)) return false;
+	if(gen != PlaceGen::ALIGN) return true;
+
+	// ALIGN depends on the placement of prevs, compares the cores of all tiles.
+	const UniqueLayout& ofmL = getOfmL();
+	const UniqueLayout& other = sch.getOfmL();
+	if(ofmL.totLength() != other.totLength()) return false;
+	for(UniqueLayout::dataLen_t i = 0; i < ofmL.totLength(); ++i){
+		if(!(ofmL[i].tile == other[i].tile)) return false;
+	}
+	return true;
+}
+
 void PlaceSch::finalize(){
 	ifmLayout->finalize();
 	wgtLayout->finalize();
@@ -99,14 +183,26 @@ std::ostream& operator<<(std::ostream& os, const PlaceSch& sch){
 		}
 		if(i != 3) os << ',';
 	}
-	return os << ')';
+	os << ')';
+	switch(sch.gen){
+	case PlaceGen::HILBERT: os << "@hilbert";
+		break;
+	case PlaceGen::ZORDER: os << "@zorder";
+		break;
+	case PlaceGen::ALIGN: os << "@align";
+		break;
+	default:
+		break;
+	}
+	return os;
 }
 
-PlaceIter PlaceEngine::init(PlaceSch& cur_sch){
-	return PlaceIter(cur_sch);
+PlaceIter PlaceEngine::init(PlaceSch& cur_sch, cost_t low_bound){
+	return PlaceIter(cur_sch, low_bound);
 }
 
-PlaceIter::PlaceIter(PlaceSch& placeSch) : curSch(placeSch){
+PlaceIter::PlaceIter(PlaceSch& placeSch, cost_t low_bound)
+	: pruned(false), lowBound(low_bound), curSch(placeSch){
 	std::uint8_t first = 0, last = 3;
 	for(std::uint8_t i=0; i<4; ++i){
 		if(curSch.part[i] == 1){
@@ -117,12 +213,38 @@ PlaceIter::PlaceIter(PlaceSch& placeSch) : curSch(placeSch){
 	}
 	assert(first == ++last);
 	perm_len = first;
-	hasNext = true;
+	hasNext = nextGen(true);
+}
+
+bool PlaceIter::nextGen(bool first){
+	int g = first ? 0 : static_cast<int>(curSch.gen) + 1;
+	for(; g < static_cast<int>(PlaceGen::NUM); ++g){
+		if((PlaceEngine::gen_mask >> g) & 1){
+			curSch.gen = static_cast<PlaceGen>(g);
+			return true;
+		}
+	}
+	return false;
 }
 
 bool PlaceIter::nextPlace(cost_t cost){
-	(void) cost;
-	return hasNext = std::next_permutation(curSch.order, curSch.order+perm_len);
+	// ALIGN does not depend on the order, all orders are iterated for other generators.
+	// (After the last permutation, order is reset to the first one.)
+	hasNext = (curSch.gen != PlaceGen::ALIGN) && std::next_permutation(curSch.order, curSch.order+perm_len);
+	if(!hasNext) hasNext = nextGen(false);
+	if(hasNext && lowBound >= cost){
+		pruned = true;
+		hasNext = false;
+	}
+	return hasNext;
+}
+
+void PlaceIter::setLowBound(cost_t low_bound){
+	lowBound = low_bound;
+}
+
+bool PlaceIter::is_pruned() const{
+	return pruned;
 }
 
 PlaceIter::operator bool() const{
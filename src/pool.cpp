@@ -0,0 +1,99 @@
+#include "pool.h"
+
+#include <new>
+
+
+thread_local MemPool::FreeList* MemPool::local = nullptr;
+thread_local MemPool::Releaser MemPool::releaser;
+std::mutex MemPool::global_lock;
+MemPool::Block* MemPool::global[MemPool::NUM_CLASS] = {};
+
+MemPool::Releaser::~Releaser(){
+	FreeList* list = local;
+	if(list == nullptr) return;
+	std::lock_guard<std::mutex> guard(global_lock);
+	for(std::size_t cls = 0; cls < NUM_CLASS; ++cls){
+		Block* head = list->head[cls];
+		if(head == nullptr) continue;
+		Block* tail = head;
+		while(tail->next != nullptr) tail = tail->next;
+		tail->next = global[cls];
+		global[cls] = head;
+		list->head[cls] = nullptr;
+	}
+	list->released = true;
+}
+
+MemPool::FreeList& MemPool::get_local(){
+	if(local == nullptr){
+		local = new FreeList();
+		// Registers the releaser of this thread.
+		(void)&releaser;
+	}
+	return *local;
+}
+
+MemPool::Block* MemPool::refill(std::size_t cls){
+	{
+		// Take the whole list of exited threads, if any.
+		std::lock_guard<std::mutex> guard(global_lock);
+		if(global[cls] != nullptr){
+			Block* list = global[cls];
+			global[cls] = nullptr;
+			return list;
+		}
+	}
+
+	// Otherwise cut a new chunk into blocks.
+	const std::size_t size = (cls + 1) * ALIGN;
+	const std::size_t num = CHUNK_SIZE / size;
+	char* chunk = static_cast<char*>(::operator new(num * size));
+	Block* list = nullptr;
+	for(std::size_t i = num; i > 0; --i){
+		Block* b = reinterpret_cast<Block*>(chunk + (i - 1) * size);
+		b->next = list;
+		list = b;
+	}
+	return list;
+}
+
+void* MemPool::alloc(std::size_t size){
+	if(size > MAX_SIZE) return ::operator new(size);
+	const std::size_t cls = (size == 0) ? 0 : (size - 1) / ALIGN;
+
+	FreeList& list = get_local();
+	Block*& head = list.head[cls];
+	if(head == nullptr) head = refill(cls);
+	Block* b = head;
+	head = b->next;
+	if(list.released && head != nullptr){
+		// Keeps the rest in the global list after the thread exits.
+		std::lock_guard<std::mutex> guard(global_lock);
+		Block* tail = head;
+		while(tail->next != nullptr) tail = tail->next;
+		tail->next = global[cls];
+		global[cls] = head;
+		head = nullptr;
+	}
+	return b;
+}
+
+void MemPool::free(void* ptr, std::size_t size) noexcept{
+	if(ptr == nullptr) return;
+	if(size > MAX_SIZE){
+		::operator delete(ptr);
+		return;
+	}
+	const std::size_t cls = (size == 0) ? 0 : (size - 1) / ALIGN;
+
+	Block* b = static_cast<Block*>(ptr);
+	FreeList& list = get_local();
+	if(list.released){
+		std::lock_guard<std::mutex> guard(global_lock);
+		b->next = global[cls];
+		global[cls] = b;
+		return;
+	}
+	b->next = list.head[cls];
+	list.head[cls] = b;
+}
@@ -70,6 +70,8 @@ namespace {
 }
 
 int SAEngine::nrounds;
+LayerEngine* SAEngine::fastMapper = nullptr;
+double SAEngine::fast_ratio = 0;
 
 void SAEngine::halv_bat(LTreeNode* node){
 	if(!node->children.empty() && node->children.front()->num_batch == node->num_batch){
@@ -159,6 +161,25 @@ void SAEngine::SA_search(WholeSch& w_sch, const Cluster& c, lid_t max_depth, int
 	cur_tries = 0;
 	cur_round = 0;
 
+	// Rounds in [0, fast_end) are searched with fastMapper.
+	int fast_end = (fastMapper == nullptr) ? 0 : static_cast<int>(fast_ratio * nrounds);
+	// The initial RA Tree (by the global engine), used if the best tree
+	// becomes invalid when re-searched by the global engine.
+	WholeSch init_sch;
+	if(fast_end > 0){
+		SchNode::threadMapper = fastMapper;
+		SchNode* fast_res = SchNode::newNode(cur_node, c, nullptr);
+		if(fast_res->is_valid()){
+			init_sch = w_sch.copy();
+			delete min_res;
+			min_res = cur_res = fast_res;
+		}else{
+			delete fast_res;
+			SchNode::threadMapper = nullptr;
+			fast_end = 0;
+		}
+	}
+
 	// bool stop_ping = false;
 	// std::thread ping(ping_func, ref(stop_ping));
 
@@ -171,6 +192,42 @@ void SAEngine::SA_search(WholeSch& w_sch, const Cluster& c, lid_t max_depth, int
 			num_tries = 0;
 		}
 
+		// Switch to the global engine, and re-search the current & best trees.
+		if(fast_end > 0 && cur_round == fast_end){
+			SchNode::threadMapper = nullptr;
+			out << "Switch to the global layer engine." << std::endl;
+
+			bool cur_is_min = (cur_node == min_node);
+			SchNode* res = SchNode::newNode(min_node, c, nullptr);
+			delete min_res;
+			if(res->is_valid()){
+				min_res = res;
+				init_sch.del();
+			}else{
+				delete res;
+				delete min_node;
+				min_node = init_sch.tree;
+				min_res = init_sch.sch;
+				init_sch = WholeSch();
+			}
+
+			if(cur_is_min){
+				cur_node = min_node;
+				cur_res = min_res;
+			}else{
+				res = SchNode::newNode(cur_node, c, nullptr);
+				delete cur_res;
+				if(res->is_valid()){
+					cur_res = res;
+				}else{
+					delete res;
+					delete cur_node;
+					cur_node = min_node;
+					cur_res = min_res;
+				}
+			}
+		}
+
 		// Change to best scheme in the last 10% rounds.
 		if(cur_round >= 0.90*nrounds && !using_best){
 			using_best = true;
@@ -246,6 +303,8 @@ void SAEngine::SA_search(WholeSch& w_sch, const Cluster& c, lid_t max_depth, int
 		delete cur_node;
 		delete cur_res;
 	}
+	init_sch.del();
+	SchNode::threadMapper = nullptr;
 
 	time_t end_time = std::time(nullptr);
 
@@ -273,7 +332,7 @@ LTreeNode* SAEngine::sa_change(LTreeNode* root, bool* valid_op, lid_t max_depth,
 		throw std::invalid_argument("The root of SA is deeper than max_depth!");
 	}
 
-	int prob[NUM_OP] = {10,10,20,20,20,20,40};
+	int prob[NUM_OP] = {10,10,20,20,20,20,40,10};
 	for(int i=1; i<NUM_OP; ++i){
 		prob[i] += prob[i-1];
 	}
@@ -668,6 +727,21 @@ LTreeNode* SAEngine::sa_change(LTreeNode* root, bool* valid_op, lid_t max_depth,
 
 			ok=true;
 		}break;
+		case 7:{
+			// Pin/stream the weights of lnode.
+
+			const Node& layerT = network->getNode(l);
+			if(layerT.hasWgtPrevs() || layerT.layer().weight_size() == 0) break;
+
+			lnode->wgt_stream = !lnode->wgt_stream;
+
+			// Now we'll reset the whole seg.
+			LTreeNode* cur = lnode;
+			while(cur->parent != root) cur = cur->parent;
+			cur->isNewNode = true;
+
+			ok=true;
+		}break;
 		default:
 			break;
 		}
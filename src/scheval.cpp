@@ -0,0 +1,477 @@
+#include "scheval.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "cluster.h"
+#include "network.h"
+#include "topology.h"
+
+
+/* #################### DenseUsage #################### */
+
+SchEval::DenseUsage::DenseUsage(vol_t* _data, cidx_t _num_cores, vol_t _capacity)
+	:data(_data), num_cores(_num_cores), capacity(_capacity), valid(true){}
+
+SchEval::DenseUsage::DenseUsage(const DenseUsage& other)
+	:own(other.data, other.data + other.num_cores), num_cores(other.num_cores),
+	 capacity(other.capacity), valid(other.valid){
+	data = own.data();
+}
+
+bool SchEval::DenseUsage::fits() const{
+	for(cidx_t c = 0; c < num_cores; ++c){
+		if(data[c] > capacity) return false;
+	}
+	return true;
+}
+
+SchEval::DenseUsage::operator bool() const{
+	return valid;
+}
+
+SchEval::DenseUsage SchEval::DenseUsage::operator+(const DenseUsage& other) const{
+	DenseUsage u = *this;
+	u += other;
+	return u;
+}
+
+SchEval::DenseUsage& SchEval::DenseUsage::operator+=(const DenseUsage& other){
+	if(!valid || !other.valid){
+		valid = false;
+		return *this;
+	}
+	for(cidx_t c = 0; c < num_cores; ++c) data[c] += other.data[c];
+	valid = fits();
+	return *this;
+}
+
+void SchEval::DenseUsage::max_with(const DenseUsage& other){
+	if(!valid || !other.valid){
+		valid = false;
+		return;
+	}
+	for(cidx_t c = 0; c < num_cores; ++c) data[c] = MAX(data[c], other.data[c]);
+}
+
+bool SchEval::DenseUsage::multiple(vol_t n){
+	if(!valid) return false;
+	for(cidx_t c = 0; c < num_cores; ++c) data[c] *= n;
+	valid = fits();
+	return valid;
+}
+
+
+/* #################### SchEval #################### */
+
+SchEval::SchEval(const SchNode* root)
+	:num_nodes(0), num_cores(static_cast<cidx_t>(Cluster::xlen * Cluster::ylen)),
+	 capacity(root->get_buf_usage().get_capacity()){
+	flatten(root, true, root->get_type() != NodeType::T);
+	child_begin.push_back(static_cast<nid_t>(child_list.size()));
+}
+
+SchEval::nid_t SchEval::flatten(const SchNode* node, bool is_top, bool is_seg){
+	std::vector<nid_t> cids;
+	len_t bgrp = 1;
+	lid_t stages = 0;
+	const LNode* lnode = nullptr;
+
+	switch(node->get_type()){
+	case NodeType::L:
+		lnode = static_cast<const LNode*>(node);
+		break;
+	case NodeType::S:
+		stages = static_cast<const SCut*>(node)->get_num_stage();
+	[[clang::fallthrough]];
+	case NodeType::T:{
+		const Cut* cut = static_cast<const Cut*>(node);
+		bgrp = cut->get_num_bgrp();
+		// Only children of the DRAM cut are segments.
+		bool child_seg = is_top && node->get_type() == NodeType::T;
+		for(auto child: cut->getChildren()){
+			cids.push_back(flatten(child, false, child_seg));
+		}
+		break;
+	}
+	}
+
+	nid_t id = num_nodes++;
+	std::uint8_t f = 0;
+	if(is_top) f |= IS_TOP;
+	if(is_seg) f |= IS_SEG;
+	if(is_seg && bgrp == 1 && node->get_type() == NodeType::T) f |= WGT_SHIFT;
+
+	type.push_back(node->get_type());
+	flags.push_back(f);
+	num_bgrp.push_back(bgrp);
+	num_stage.push_back(stages);
+	cluster_size.push_back(node->get_cluster().num_cores());
+	lnodes.push_back(lnode);
+	child_begin.push_back(static_cast<nid_t>(child_list.size()));
+	child_list.insert(child_list.end(), cids.begin(), cids.end());
+	noc_idx.push_back((is_top || is_seg) ? static_cast<nid_t>(seg_noc.size()) : NONE);
+	if(is_top || is_seg) seg_noc.emplace_back();
+	return id;
+}
+
+SchEval::Row SchEval::row(nid_t id){
+	const std::size_t off = static_cast<std::size_t>(id) * num_cores;
+	return Row{cost[id], ubuf_energy[id], buf_energy[id], bus_energy[id], mac_energy[id],
+		DenseUsage(ifm_usage.data() + off, num_cores, capacity),
+		DenseUsage(wgt_usage.data() + off, num_cores, capacity),
+		DenseUsage(buf_usage.data() + off, num_cores, capacity)};
+}
+
+void SchEval::addNoC(nid_t id, len_t factor, NoC& noc) const{
+	if(type[id] == NodeType::L){
+		if(factor == 1){
+			noc += lnodes[id]->get_noc();
+		}else{
+			noc += lnodes[id]->get_noc() * factor;
+		}
+		return;
+	}
+	factor *= num_bgrp[id];
+	for(nid_t i = child_begin[id]; i < child_begin[id+1]; ++i){
+		addNoC(child_list[i], factor, noc);
+	}
+}
+
+void SchEval::evalLNode(nid_t id){
+	const LNode* node = lnodes[id];
+	valid[id] = node->is_valid();
+	cost[id] = node->get_cost();
+	ubuf_energy[id] = node->get_ubuf_energy();
+	buf_energy[id] = node->get_buf_energy();
+	bus_energy[id] = node->get_bus_energy();
+	mac_energy[id] = node->get_mac_energy();
+
+	const std::size_t off = static_cast<std::size_t>(id) * num_cores;
+	auto fill = [&](std::vector<vol_t>& vec, const BufferUsage& u){
+		u.for_each([&](pos_t core, vol_t size){
+			vec[off + core.x * Cluster::ylen + core.y] = size;
+		});
+	};
+	fill(ifm_usage, node->get_ifm_usage());
+	fill(wgt_usage, node->get_wgt_usage());
+	fill(buf_usage, node->get_buf_usage());
+}
+
+bool SchEval::evalTCut(nid_t id){
+	const bool is_top = flags[id] & IS_TOP;
+	const bool is_seg = flags[id] & IS_SEG;
+	const bool wgt_shift = flags[id] & WGT_SHIFT;
+	Row r = row(id);
+
+	nid_t last = NONE;
+	for(nid_t i = child_begin[id]; i < child_begin[id+1]; ++i){
+		const nid_t p = child_list[i];
+		if(!valid[p]) return false;
+		const Row child = row(p);
+		if(last == NONE){
+			if(!TCut::add_child<Row>(r, child, nullptr, is_top, is_seg, wgt_shift)) return false;
+		}else{
+			const Row last_row = row(last);
+			if(!TCut::add_child<Row>(r, child, &last_row, is_top, is_seg, wgt_shift)) return false;
+		}
+		last = p;
+	}
+	return TCut::finish<Row>(r, row(child_list[child_begin[id]]), row(last), num_bgrp[id], is_top, is_seg, wgt_shift);
+}
+
+bool SchEval::evalSCut(nid_t id){
+	const bool is_seg = flags[id] & IS_SEG;
+	Row r = row(id);
+
+	cycle_t max_time = 0;
+	for(nid_t i = child_begin[id]; i < child_begin[id+1]; ++i){
+		const nid_t p = child_list[i];
+		if(!valid[p] || !SCut::add_child<Row>(r, row(p), max_time, num_bgrp[id], is_seg)){
+			return false;
+		}
+	}
+
+	// NoC of all children in one batch group, only used with phase_noc.
+	NoC noc;
+	if(SchNode::phase_noc){
+		for(nid_t i = child_begin[id]; i < child_begin[id+1]; ++i){
+			addNoC(child_list[i], 1, noc);
+		}
+	}
+	return SCut::finish<Row>(r, SCut::stage_time(max_time, noc), num_stage[id], num_bgrp[id], is_seg);
+}
+
+bool SchEval::eval(){
+	const std::size_t tot = static_cast<std::size_t>(num_nodes) * num_cores;
+	valid.assign(num_nodes, false);
+	cost.assign(num_nodes, SchCost(0, 0));
+	ubuf_energy.assign(num_nodes, 0);
+	buf_energy.assign(num_nodes, 0);
+	bus_energy.assign(num_nodes, 0);
+	mac_energy.assign(num_nodes, 0);
+	max_buf.assign(num_nodes, 0);
+	ifm_usage.assign(tot, 0);
+	wgt_usage.assign(tot, 0);
+	buf_usage.assign(tot, 0);
+
+	for(nid_t id = 0; id < num_nodes; ++id){
+		switch(type[id]){
+		case NodeType::L:
+			evalLNode(id);
+			break;
+		case NodeType::T:
+			valid[id] = evalTCut(id);
+			break;
+		case NodeType::S:
+			valid[id] = evalSCut(id);
+			break;
+		}
+		if(!valid[id]) continue;
+		const vol_t* buf = buf_usage.data() + static_cast<std::size_t>(id) * num_cores;
+		max_buf[id] = *std::max_element(buf, buf + num_cores);
+		if(noc_idx[id] == NONE) continue;
+
+		// NoC of the root (sum of segments) or a segment (sum of all LNodes).
+		NoC& noc = seg_noc[noc_idx[id]];
+		noc.clear();
+		if((flags[id] & IS_SEG) == 0){
+			for(nid_t i = child_begin[id]; i < child_begin[id+1]; ++i){
+				noc += seg_noc[noc_idx[child_list[i]]];
+			}
+			noc *= num_bgrp[id];
+			continue;
+		}
+		addNoC(id, 1, noc);
+
+		// For each segment, also bound NoC & DRAM time (LNodes already did)
+		if(type[id] != NodeType::L){
+			cycle_t noc_time = noc.get_time();
+			cost[id].time = MAX(cost[id].time, noc_time);
+		}
+	}
+	return valid[root()];
+}
+
+SchEval::nid_t SchEval::size() const{
+	return num_nodes;
+}
+
+SchEval::nid_t SchEval::root() const{
+	return num_nodes - 1;
+}
+
+SchEval::NodeType SchEval::get_type(nid_t id) const{
+	return type[id];
+}
+
+const LNode* SchEval::get_lnode(nid_t id) const{
+	return lnodes[id];
+}
+
+const SchEval::nid_t* SchEval::children_begin(nid_t id) const{
+	return child_list.data() + child_begin[id];
+}
+
+const SchEval::nid_t* SchEval::children_end(nid_t id) const{
+	return child_list.data() + child_begin[id+1];
+}
+
+bool SchEval::is_seg(nid_t id) const{
+	return flags[id] & IS_SEG;
+}
+
+len_t SchEval::get_num_bgrp(nid_t id) const{
+	return num_bgrp[id];
+}
+
+bool SchEval::is_valid(nid_t id) const{
+	return valid[id];
+}
+
+SchEval::SchCost SchEval::get_cost(nid_t id) const{
+	if(!valid[id]) return SchCost();
+	return cost[id];
+}
+
+energy_t SchEval::get_ubuf_energy(nid_t id) const{
+	return ubuf_energy[id];
+}
+
+energy_t SchEval::get_buf_energy(nid_t id) const{
+	return buf_energy[id];
+}
+
+energy_t SchEval::get_bus_energy(nid_t id) const{
+	return bus_energy[id];
+}
+
+energy_t SchEval::get_mac_energy(nid_t id) const{
+	return mac_energy[id];
+}
+
+vol_t SchEval::get_max_buf(nid_t id) const{
+	if(!valid[id]) return 0;
+	return max_buf[id];
+}
+
+const NoC* SchEval::get_noc(nid_t id) const{
+	if(noc_idx[id] == NONE) return nullptr;
+	return &seg_noc[noc_idx[id]];
+}
+
+void SchEval::number_nodes(std::vector<len_t>& repeat, std::vector<long>& segment) const{
+	// Repeat times and segment index of each node, from top to bottom.
+	repeat.assign(num_nodes, 1);
+	segment.assign(num_nodes, -1);
+	long num_seg = 0;
+	const nid_t r = root();
+	if(flags[r] & IS_SEG) segment[r] = num_seg++;
+	for(nid_t id = num_nodes; id-- > 0;){
+		for(nid_t i = child_begin[id]; i < child_begin[id+1]; ++i){
+			const nid_t c = child_list[i];
+			repeat[c] = repeat[id] * num_bgrp[id];
+			segment[c] = (flags[c] & IS_SEG) ? num_seg++ : segment[id];
+		}
+	}
+}
+
+void SchEval::print_breakdown(std::ostream& os) const{
+	std::vector<len_t> repeat;
+	std::vector<long> segment;
+	number_nodes(repeat, segment);
+	const nid_t r = root();
+
+	auto print_row = [&](const char* row_type, nid_t id){
+		const bool is_layer = (type[id] == NodeType::L);
+		const NoC* noc = is_layer ? &lnodes[id]->get_noc() : get_noc(id);
+		const SchCost c = get_cost(id);
+
+		os << row_type << ',' << segment[id] << ',';
+		if(is_layer){
+			os << lnodes[id]->getLayer().name() << ',' << lnodes[id]->get_num_batch() << ',';
+		}else{
+			os << ((type[id] == NodeType::S) ? 'S' : 'T') << ",,";
+		}
+		os << repeat[id] << ',' << cluster_size[id] << ',';
+		os << c.energy << ',' << c.time << ',' << c.cost() << ',';
+		os << ubuf_energy[id] << ',' << buf_energy[id] << ',';
+		os << bus_energy[id] << ',' << mac_energy[id] << ',';
+		os << noc->get_hop_cost() << ',' << noc->get_DRAM_cost() << ',';
+		if(is_layer){
+			const auto& tileSch = lnodes[id]->get_tile_sch();
+			os << tileSch.util << ',' << tileSch.tot_util << ',';
+		}else{
+			os << ",,";
+		}
+		os << noc->get_max_link() << ',' << noc->get_time() << ',';
+		os << get_max_buf(id) << std::endl;
+	};
+
+	os << "type,segment,name,num_batch,repeat,cores,energy,time,cost,";
+	os << "ubuf_energy,buf_energy,bus_energy,mac_energy,noc_energy,DRAM_energy,";
+	os << "util,tot_util,max_link,noc_time,max_buf" << std::endl;
+	for(nid_t id = 0; id < num_nodes; ++id){
+		if(type[id] == NodeType::L) print_row("layer", id);
+		if(flags[id] & IS_SEG) print_row("segment", id);
+	}
+	print_row("total", r);
+}
+
+// Name of link direction *dir*, "x" for express links.
+static const char* dir_name(mlen_t dir){
+	static const char* const names[] = {"E", "S", "W", "N", "xE", "xS", "xW", "xN"};
+	return names[dir];
+}
+
+static cycle_t link_cycles(const NoC::link_info& link){
+	return DIVCEIL(link.total_hops, link.d2d ? Topology::d2d_bw : NoC::NoC_bw);
+}
+
+void SchEval::print_links(std::ostream& os) const{
+	std::vector<len_t> repeat;
+	std::vector<long> segment;
+	number_nodes(repeat, segment);
+
+	auto print_noc = [&](const char* row_type, nid_t id){
+		const NoC& noc = *get_noc(id);
+		const double t = static_cast<double>(cost[id].time);
+		for(const auto& link: noc.get_link_info()){
+			const cycle_t c = link_cycles(link);
+			os << row_type << ',' << segment[id] << ",link,";
+			os << static_cast<int>(link.from.x) << ',' << static_cast<int>(link.from.y) << ',';
+			os << static_cast<int>(link.dir) << ',';
+			os << static_cast<int>(link.to.x) << ',' << static_cast<int>(link.to.y) << ',';
+			os << link.total_hops << ',' << c << ',' << ((t > 0) ? c / t : 0) << std::endl;
+		}
+		const auto& acc = noc.get_port_acc();
+		for(std::size_t i = 0; i < acc.size(); ++i){
+			const cycle_t c = DIVCEIL(acc[i], NoC::dram_port_bw[i]);
+			const pos_t& port = NoC::dram_list[i];
+			os << row_type << ',' << segment[id] << ",dram,";
+			os << static_cast<int>(port.x) << ',' << static_cast<int>(port.y) << ",,,,";
+			os << acc[i] << ',' << c << ',' << ((t > 0) ? c / t : 0) << std::endl;
+		}
+	};
+
+	os << "type,segment,kind,x,y,dir,to_x,to_y,load,cycles,ratio" << std::endl;
+	for(nid_t id = 0; id < num_nodes; ++id){
+		if(valid[id] && (flags[id] & IS_SEG)) print_noc("segment", id);
+	}
+	if(valid[root()]) print_noc("total", root());
+}
+
+void SchEval::print_hotspots(std::ostream& os, std::size_t top) const{
+	std::vector<len_t> repeat;
+	std::vector<long> segment;
+	number_nodes(repeat, segment);
+
+	auto print_noc = [&](nid_t id){
+		const NoC& noc = *get_noc(id);
+		const double t = static_cast<double>(cost[id].time);
+		os << "Time: " << cost[id].time << ", NoC & DRAM latency bound: " << noc.get_time() << std::endl;
+
+		// Links with the most cycles (D2D links have a lower bandwidth).
+		auto links = noc.get_link_info();
+		std::stable_sort(links.begin(), links.end(), [](const NoC::link_info& a, const NoC::link_info& b){
+			return link_cycles(a) > link_cycles(b);
+		});
+		if(links.size() > top) links.resize(top);
+		for(const auto& link: links){
+			const cycle_t c = link_cycles(link);
+			os << '\t' << link.from << " -> " << link.to << ' ' << dir_name(link.dir);
+			if(link.d2d) os << " (D2D)";
+			os << "\thops: " << link.total_hops << "\tcycles: " << c;
+			if(t > 0) os << " (" << 100 * c / t << "%)";
+			os << std::endl;
+		}
+
+		const auto& acc = noc.get_port_acc();
+		std::vector<std::size_t> ports(acc.size());
+		for(std::size_t i = 0; i < ports.size(); ++i) ports[i] = i;
+		auto port_cycles = [&](std::size_t i) -> cycle_t{
+			return DIVCEIL(acc[i], NoC::dram_port_bw[i]);
+		};
+		std::stable_sort(ports.begin(), ports.end(), [&](std::size_t a, std::size_t b){
+			return port_cycles(a) > port_cycles(b);
+		});
+		if(ports.size() > top) ports.resize(top);
+		for(std::size_t i: ports){
+			const cycle_t c = port_cycles(i);
+			os << "\tDRAM " << NoC::dram_list[i] << "\taccess: " << acc[i] << "\tcycles: " << c;
+			if(t > 0) os << " (" << 100 * c / t << "%)";
+			os << std::endl;
+		}
+	};
+
+	for(nid_t id = 0; id < num_nodes; ++id){
+		if(!valid[id] || (flags[id] & IS_SEG) == 0) continue;
+		os << "[Segment " << segment[id] << "] ";
+		print_noc(id);
+		os << std::endl;
+	}
+	if(valid[root()]){
+		os << "[Total] ";
+		print_noc(root());
+	}
+}
@@ -1,9 +1,11 @@
 #include "schnode.h"
 
 #include <cassert>
+#include <stdexcept>
 
 #include "layerengine.h"
 #include "network.h"
+#include "scheval.h"
 #ifndef NOT_GEN_IR
 #include "json/json.h"
 #endif
@@ -12,7 +14,9 @@
 /* #################### SchNode #################### */
 
 LayerEngine* SchNode::layerMapper=nullptr;
+thread_local LayerEngine* SchNode::threadMapper=nullptr;
 len_t SchNode::tot_batch=0;
+bool SchNode::phase_noc=false;
 
 SchNode::sn_ptr SchNode::newNode(LTreeNode* _node, const Cluster& _c, Cut* parent){
 	switch (_node->get_type()) {
@@ -29,7 +33,8 @@ SchNode::sn_ptr SchNode::newNode(LTreeNode* _node, const Cluster& _c, Cut* paren
 
 SchNode::SchNode(NodeType t, const Cluster& _c, cut_ptr _parent, len_t nbatch)
 	:valid(true), type(t), num_batch(nbatch), cluster(_c), parent(_parent),
-	 lnodeList(parent != nullptr ? parent->lnodeList : new nodeList_t){
+	 lnodeList(parent != nullptr ? parent->lnodeList : new nodeList_t),
+	 incState(parent != nullptr ? parent->incState : nullptr){
 	assert(nbatch == 0 || _parent == nullptr || _parent->num_batch % nbatch == 0);
 	if(_parent != nullptr) _parent->add(this);
 }
@@ -40,6 +45,8 @@ SchNode::~SchNode(){
 
 void SchNode::setParent(Cut* newParent){
 	const_cast<Cut*&>(parent) = newParent;
+	// Copies are never made during incremental search.
+	incState = nullptr;
 	if(newParent == nullptr){
 		const_cast<nodeList_t*&>(lnodeList) = new nodeList_t;
 	}else{
@@ -64,10 +71,18 @@ const Cluster& SchNode::get_cluster() const{
 	return cluster;
 }
 
+len_t SchNode::get_num_batch() const{
+	return num_batch;
+}
+
 SchNode::SchCost SchNode::get_cost() const{
 	return cost;
 }
 
+const SchResult& SchNode::get_result() const{
+	return *this;
+}
+
 const NoC& SchNode::get_noc() const{
 	return noc;
 }
@@ -100,7 +115,7 @@ energy_t SchNode::get_mac_energy() const{
 	return mac_energy;
 }
 
-void SchNode::print_summary(std::ostream& os) const{
+void SchNode::print_summary(std::ostream& os, const SchEval* eval) const{
 	os << "[Cost Summary]" << std::endl;
 	os << "Energy: " << cost.energy << std::endl;
 	os << "Latency: " << cost.time << std::endl;
@@ -122,6 +137,14 @@ void SchNode::print_summary(std::ostream& os) const{
 	if(e > 1e-8 || e < -1e-8){
 		os << std::endl << "[Error]: cost mismatch! error: " << e;
 	}
+
+	// Cross-check the aggregation with the flat evaluator.
+	if(eval != nullptr){
+		if(!eval->is_valid(eval->root()) || eval->get_cost(eval->root()) != cost){
+			os << std::endl << "[Error]: evaluator mismatch! ";
+			os << eval->get_cost(eval->root()).energy << ' ' << eval->get_cost(eval->root()).time;
+		}
+	}
 }
 
 std::ostream& operator<<(std::ostream& os, const SchNode& sch){
@@ -141,8 +164,12 @@ std::ostream& operator<<(std::ostream& os, const SchNode* sch){
 
 /* #################### LNode #################### */
 
+LayerEngine* SchNode::get_mapper(){
+	return (threadMapper != nullptr) ? threadMapper : layerMapper;
+}
+
 bool LNode::search(){
-	auto res = layerMapper->search(this);
+	auto res = get_mapper()->search(this);
 
 	// If no valid scheme found, return
 	if(!res.isValid()) return false;
@@ -160,16 +187,73 @@ bool LNode::search(){
 LNode::LNode(LTreeNode *_node, const Cluster& _c, SchNode::cut_ptr _parent)
 	:SchNode(NodeType::L, _c, _parent, _node->get_tot_batch()), layerid(_node->layers().first()),
 	  layert(network->getNode(layerid)), /*place_sch(cluster, layert, _node->get_tot_batch()),*/
-	dirp_set(_node->get_dirp_set()), to_dram(_node->get_to_dram()){
+	dirp_set(_node->get_dirp_set()), to_dram(_node->get_to_dram()),
+	wgt_stream(_node->get_wgt_stream()), engine(get_mapper()){
 	searchLayer();
 }
 
+/*
+ * The scheme of an LNode only depends on its cluster, #batch, to_dram,
+ * wgt_stream, dirp_set, the layer engine and the placement of its direct prevs.
+ * If all of them are unchanged, the old scheme can be reused directly.
+ */
+const LNode* LNode::findReusable() const{
+	if(incState == nullptr) return nullptr;
+	const nodeList_t& oldList = incState->oldLNodes;
+	auto it = oldList.find(layerid);
+	if(it == oldList.end() || it->second == nullptr) return nullptr;
+	const LNode* old = it->second;
+
+	if(!old->valid || old->cluster != cluster || old->num_batch != num_batch) return nullptr;
+	if(old->to_dram != to_dram || !(old->dirp_set == dirp_set)) return nullptr;
+	if(old->wgt_stream != wgt_stream) return nullptr;
+	if(old->engine != engine) return nullptr;
+	bool is_seg = (parent == nullptr) || parent->is_DRAM_cut();
+	bool old_seg = (old->parent == nullptr) || old->parent->is_DRAM_cut();
+	if(is_seg != old_seg) return nullptr;
+
+	// With DRAM layouts, prevs in DRAM are fetched from ports decided by their placement.
+	const Bitset& prevs = NoC::dram_layout ? layert.getPrevs() : dirp_set;
+	FOR_BITSET(prev, prevs){
+		auto oldIt = oldList.find(prev);
+		auto curIt = lnodeList->find(prev);
+		bool found = (oldIt != oldList.end() && curIt != lnodeList->end());
+		if(!found && dirp_set.contains(prev)) return nullptr;
+		const LNode* oldPrev = (oldIt == oldList.end()) ? nullptr : oldIt->second;
+		const LNode* curPrev = (curIt == lnodeList->end()) ? nullptr : curIt->second;
+		if(oldPrev == curPrev) continue;
+		if(oldPrev == nullptr || curPrev == nullptr) return nullptr;
+		if(oldPrev->cluster != curPrev->cluster || oldPrev->num_batch != curPrev->num_batch)
+			return nullptr;
+		if(!oldPrev->place_sch.sameScheme(curPrev->place_sch)) return nullptr;
+	}
+	return old;
+}
+
 LNode::~LNode(){
 	auto& ptr = (*lnodeList)[layerid];
 	if(ptr == this) ptr = nullptr;
 }
 
 void LNode::searchLayer(){
+	// In incremental search, reuse the old scheme if possible.
+	const LNode* old = findReusable();
+	if(old != nullptr){
+		noc = old->noc;
+		place_sch = PlaceSch(old->place_sch);
+		tileSch = old->tileSch;
+		cost = old->cost;
+		ubuf_energy = old->ubuf_energy;
+		buf_energy = old->buf_energy;
+		bus_energy = old->bus_energy;
+		mac_energy = old->mac_energy;
+		ifm_usage = old->ifm_usage;
+		wgt_usage = old->wgt_usage;
+		buf_usage = old->buf_usage;
+		(*lnodeList)[layerid] = this;
+		return;
+	}
+
 	valid = search();
 	if(!valid){
 		return;
@@ -182,7 +266,8 @@ void LNode::searchLayer(){
 	}
 
 	// Update weight buffer usage
-	if(!place_sch.getWgtL().update(layert.hasWgtPrevs() ? ifm_usage : wgt_usage)){
+	// Streamed weights are fetched in each batch group, just like ifmaps.
+	if(!place_sch.getWgtL().update((layert.hasWgtPrevs() || wgt_stream) ? ifm_usage : wgt_usage)){
 		valid = false;
 		return;
 	}
@@ -207,9 +292,9 @@ void LNode::searchLayer(){
 	bus_energy = tileSch.noc * cluster.num_cores();
 	mac_energy = tileSch.mac * cluster.num_cores();
 
-	// For each segment, also bound NoC & DRAM time
+	// For each segment (or each phase), also bound NoC & DRAM time
 	bool is_seg = (parent == nullptr) || parent->is_DRAM_cut();
-	if(is_seg){
+	if(is_seg || phase_noc){
 		cycle_t noc_time = noc.get_time();
 		cost.time = MAX(cost.time, noc_time);
 	}
@@ -251,6 +336,14 @@ bool LNode::get_to_dram() const{
 	return to_dram;
 }
 
+bool LNode::get_wgt_stream() const{
+	return wgt_stream;
+}
+
+const CoreMapper::CoreMapping& LNode::get_tile_sch() const{
+	return tileSch;
+}
+
 void LNode::print_scheme(std::string pad, std::ostream& os) const{
 	os << pad << layert.name() << ' ' << num_batch << ' ' << place_sch;
 	os << " util:" << tileSch.util*100 << '/' << tileSch.tot_util*100;
@@ -265,6 +358,7 @@ void LNode::print_scheme(std::string pad, std::ostream& os) const{
 
 void LNode::print_tree(std::string pad, std::ostream& os) const{
 	os << pad << layert.name() << ' ' << num_batch;
+	if(wgt_stream) os << " wgt_stream";
 	// os << ' ' << place_sch;
 	os << std::endl;
 }
@@ -322,7 +416,8 @@ SchNode::sn_ptr Cut::newNode(LTreeNode* _node, const Cluster& _c){
 			return node;
 		}
 
-		delete node;
+		// Old LNodes may still be reused, delete them after the search.
+		incState->staleNodes.push_back(node);
 		if(reSearch) return SchNode::newNode(_node, _c, this);
 	}
 
@@ -330,6 +425,23 @@ SchNode::sn_ptr Cut::newNode(LTreeNode* _node, const Cluster& _c){
 	return SchNode::newNode(_node, _c, this);
 }
 
+vol_t Cut::pinnedWgtVol(LTreeNode* node) const{
+	if(node->get_type() != LTreeNode::NodeType::L){
+		vol_t totWgt = 0;
+		for(auto child: node->get_children()) totWgt += pinnedWgtVol(child);
+		return totWgt;
+	}
+	const Node& layerT = network->getNode(node->layers().first());
+	// Weights from prev layers and streamed weights are stored with ifmap.
+	if(layerT.hasWgtPrevs() || node->get_wgt_stream()) return 0;
+	return layerT.get_min_wgt_vol(num_batch);
+}
+
+bool Cut::pinnedWgtFits(LTreeNode* node) const{
+	vol_t minWgt = DIVCEIL(pinnedWgtVol(node), static_cast<vol_t>(cluster.num_cores()));
+	return minWgt <= layerMapper->get_ubuf_size();
+}
+
 void Cut::add(SchNode* child){
 	children.push_back(child);
 }
@@ -337,16 +449,27 @@ void Cut::add(SchNode* child){
 void Cut::searchInc(LTreeNode* node){
 	assert(node->layers() == layers);
 
+	/*
+	 * The top-level call owns the search state.
+	 * All replaced nodes are kept alive until the whole search finishes,
+	 * so that unchanged LNodes can reuse their old schemes.
+	 */
+	IncState topState;
+	bool is_top = (parent == nullptr || parent->incState == nullptr);
+	if(is_top){
+		topState.oldLNodes = *lnodeList;
+		incState = &topState;
+	}else{
+		incState = parent->incState;
+	}
+
 	// Move old nodes aside
 	curNode = node;
 	oldChildren = std::move(children);
 
 	// Clear relative information
 	children.clear();
-	noc.clear();
-	ifm_usage = BufferUsage();
-	wgt_usage = BufferUsage();
-	buf_usage = BufferUsage();
+	reset();
 
 	/*
 	 * Re-construct, now newNode() in construct() will
@@ -356,10 +479,17 @@ void Cut::searchInc(LTreeNode* node){
 
 	// Clear old nodes
 	while(!oldChildren.empty()){
-		delete oldChildren.front();
+		incState->staleNodes.push_back(oldChildren.front());
 		oldChildren.pop_front();
 	}
 	curNode = nullptr;
+
+	if(is_top){
+		for(auto child: topState.staleNodes){
+			delete child;
+		}
+	}
+	incState = nullptr;
 }
 
 bool Cut::contains(lid_t layerid) const{
@@ -415,108 +545,127 @@ void TCut::construct(LTreeNode* node){
 	 */
 	bool wgt_shift = is_seg && (num_bgrp == 1);
 
+	// Otherwise weights of all children are pinned.
+	if(!is_top && !wgt_shift && !pinnedWgtFits(node)){
+		valid = false;
+		return;
+	}
+
 	// Recursively construct (and search) each child.
 	sn_ptr last_p = nullptr;
-	cost.energy = 0;
-	cost.time = 0;
-	ubuf_energy = buf_energy = bus_energy = mac_energy = 0;
+	reset();
 	for(auto child: node->get_children()){
 		sn_ptr p = newNode(child, cluster);
 		if(!p->is_valid()){
 			valid = false;
 			return;
 		}
+		if(!add_child<SchResult>(*this, p->get_result(), (last_p == nullptr) ? nullptr : &last_p->get_result(), is_top, is_seg, wgt_shift)){
+			valid = false;
+			return;
+		}
+		noc += p->get_noc();
+		last_p = p;
+	}
 
-		if(!is_top){
-			// Update ifmap usage.
-			if(!(is_seg || (ifm_usage += p->get_ifm_usage()))){
-				valid = false;
-				return;
-			}
+	if(!finish<SchResult>(*this, children.front()->get_result(), last_p->get_result(), num_bgrp, is_top, is_seg, wgt_shift)){
+		valid = false;
+		return;
+	}
+	noc *= num_bgrp;
 
-			// Update buffer usage.
-			if(last_p == nullptr){
-				// No need to compute here, later computations are always larger.
-				// buf_usage = p->get_buf_usage();
+	// For each segment, also bound NoC & DRAM time
+	if(is_seg){
+		cycle_t noc_time = noc.get_time();
+		cost.time = MAX(cost.time, noc_time);
+	}
+}
+
+template<typename Res>
+bool TCut::add_child(Res& res, const Res& child, const Res* last, bool is_top, bool is_seg, bool wgt_shift){
+	if(!is_top){
+		// Update ifmap usage.
+		if(!(is_seg || (res.ifm_usage += child.ifm_usage))){
+			return false;
+		}
+
+		// Update buffer usage.
+		if(last == nullptr){
+			// No need to compute here, later computations are always larger.
+			// buf_usage = child.buf_usage;
+		}else{
+			if(wgt_shift){
+				// With weight shift, weight is handled just like ifmap.
+				res.buf_usage.max_with(child.ifm_usage + last->buf_usage + last->wgt_usage + child.wgt_usage);
 			}else{
-				if(wgt_shift){
-					// With weight shift, weight is handled just like ifmap.
-					buf_usage.max_with(p->get_ifm_usage() + last_p->get_buf_usage() + last_p->get_wgt_usage() + p->get_wgt_usage());
-				}else{
-					buf_usage.max_with(p->get_ifm_usage() + last_p->get_buf_usage());
-				}
-				if(!buf_usage){
-					valid = false;
-					return;
-				}
+				res.buf_usage.max_with(child.ifm_usage + last->buf_usage);
 			}
-
-			// Update weight usage.
-			if(!wgt_shift && !(wgt_usage += p->get_wgt_usage())){
-				valid = false;
-				return;
+			if(!res.buf_usage){
+				return false;
 			}
 		}
 
-		// Update cost and noc.
-		cost.time += p->get_cost().time;
-		cost.energy += p->get_cost().energy;
-		noc += p->get_noc();
-		ubuf_energy += p->get_ubuf_energy();
-		buf_energy += p->get_buf_energy();
-		bus_energy += p->get_bus_energy();
-		mac_energy += p->get_mac_energy();
-
-		last_p = p;
+		// Update weight usage.
+		if(!wgt_shift && !(res.wgt_usage += child.wgt_usage)){
+			return false;
+		}
 	}
 
+	// Update cost.
+	res.cost.time += child.cost.time;
+	res.cost.energy += child.cost.energy;
+	res.ubuf_energy += child.ubuf_energy;
+	res.buf_energy += child.buf_energy;
+	res.bus_energy += child.bus_energy;
+	res.mac_energy += child.mac_energy;
+	return true;
+}
+
+template<typename Res>
+bool TCut::finish(Res& res, const Res& first, const Res& last, len_t num_bgrp, bool is_top, bool is_seg, bool wgt_shift){
 	// Update and check buffer usage.
 	if(!is_top){
 		if(num_bgrp == 1){
 			if(wgt_shift){
 				// With weight shift, weight is handled just like ifmap.
-				buf_usage.max_with(last_p->get_buf_usage() + last_p->get_wgt_usage());
+				res.buf_usage.max_with(last.buf_usage + last.wgt_usage);
 			}else{
-				buf_usage.max_with(last_p->get_buf_usage());
+				res.buf_usage.max_with(last.buf_usage);
 			}
 		}else{
-			if(!(is_seg || ifm_usage.multiple(num_bgrp))){
-				valid = false;
-				return;
+			if(!(is_seg || res.ifm_usage.multiple(num_bgrp))){
+				return false;
 			}
 			if(wgt_shift){
 				// With weight shift, weight is handled just like ifmap.
-				buf_usage.max_with(children.front()->get_ifm_usage() + children.front()->get_wgt_usage() + last_p->get_buf_usage() + last_p->get_wgt_usage());
+				res.buf_usage.max_with(first.ifm_usage + first.wgt_usage + last.buf_usage + last.wgt_usage);
 			}else{
-				buf_usage.max_with(children.front()->get_ifm_usage() + last_p->get_buf_usage());
+				res.buf_usage.max_with(first.ifm_usage + last.buf_usage);
 			}
 		}
 
-		if(!buf_usage){
-			valid = false;
-			return;
+		if(!res.buf_usage){
+			return false;
 		}
 
-		if(!wgt_shift && !(buf_usage + wgt_usage)){
-			valid = false;
-			return;
+		if(!wgt_shift && !(res.buf_usage + res.wgt_usage)){
+			return false;
 		}
 	}
 
-	cost *= num_bgrp;
-	noc *= num_bgrp;
-	ubuf_energy *= num_bgrp;
-	buf_energy *= num_bgrp;
-	bus_energy *= num_bgrp;
-	mac_energy *= num_bgrp;
-
-	// For each segment, also bound NoC & DRAM time
-	if(is_seg){
-		cycle_t noc_time = noc.get_time();
-		cost.time = MAX(cost.time, noc_time);
-	}
+	res.cost *= num_bgrp;
+	res.ubuf_energy *= num_bgrp;
+	res.buf_energy *= num_bgrp;
+	res.bus_energy *= num_bgrp;
+	res.mac_energy *= num_bgrp;
+	return true;
 }
 
+template bool TCut::add_child<SchResult>(SchResult&, const SchResult&, const SchResult*, bool, bool, bool);
+template bool TCut::finish<SchResult>(SchResult&, const SchResult&, const SchResult&, len_t, bool, bool, bool);
+template bool TCut::add_child<SchEval::Row>(SchEval::Row&, const SchEval::Row&, const SchEval::Row*, bool, bool, bool);
+template bool TCut::finish<SchEval::Row>(SchEval::Row&, const SchEval::Row&, const SchEval::Row&, len_t, bool, bool, bool);
+
 TCut::TCut(LTreeNode *_node, const Cluster& _c, SchNode::cut_ptr _parent)
 	:Cut(NodeType::T, _node, _c, _parent){
 	TCut::construct(_node);
@@ -541,6 +690,12 @@ void SCut::construct(LTreeNode* node){
 	cidx_t cnum = static_cast<cidx_t>(cnodes.size());
 	assert(cnum > 0);
 
+	// Weights of all children are pinned.
+	if(!pinnedWgtFits(node)){
+		valid = false;
+		return;
+	}
+
 	// Initialize utime list.
 	utime_t* tlist = new utime_t[cnum];
 	utime_t* cur_item = tlist;
@@ -559,68 +714,25 @@ void SCut::construct(LTreeNode* node){
 	// Recursively construct (and search) each child.
 	cidx_t i=0;
 	cycle_t max_time = 0;
-	cost.energy = 0;
-	ubuf_energy = buf_energy = bus_energy = mac_energy = 0;
+	reset();
 	for(auto child: cnodes){
 		auto p = newNode(child, cluster.sub_cluster(i++, allocRes));
 		if(!p->is_valid()){
 			valid = false;
 			return;
 		}
-
-		// Update buffer usage.
-		if(num_bgrp > 1 && !(buf_usage += p->get_ifm_usage())){
-			valid = false;
-			return;
-		}
-		if(!(buf_usage += p->get_buf_usage())){
+		if(!add_child<SchResult>(*this, p->get_result(), max_time, num_bgrp, is_seg)){
 			valid = false;
 			return;
 		}
-
-		// Update weight usage
-		if(!(wgt_usage += p->get_wgt_usage())){
-			valid = false;
-			return;
-
-		}
-
-		// Update ifmap usage
-		if(!(is_seg || (ifm_usage += p->get_ifm_usage()))){
-			valid = false;
-			return;
-		}
-
-		// time needs to be updated at last (when max is computed)
-		// cost.time += p->get_cost().time;
-		cost.energy += p->get_cost().energy;
-		max_time = MAX(p->get_cost().time, max_time);
 		noc += p->get_noc();
-		ubuf_energy += p->get_ubuf_energy();
-		buf_energy += p->get_buf_energy();
-		bus_energy += p->get_bus_energy();
-		mac_energy += p->get_mac_energy();
 	}
 
-	// Update and check buffer usage.
-	if(!(buf_usage + wgt_usage)){
+	if(!finish<SchResult>(*this, stage_time(max_time, noc), num_stage, num_bgrp, is_seg)){
 		valid = false;
 		return;
 	}
-
-	ifm_usage.multiple(num_bgrp);
-	if(!(is_seg || ifm_usage)){
-		valid = false;
-		return;
-	}
-
-	cost.time = max_time * (num_stage + num_bgrp);
-	cost.energy *= num_bgrp;
 	noc *= num_bgrp;
-	ubuf_energy *= num_bgrp;
-	buf_energy *= num_bgrp;
-	bus_energy *= num_bgrp;
-	mac_energy *= num_bgrp;
 
 	// For each segment, also bound NoC & DRAM time
 	if(is_seg){
@@ -629,6 +741,63 @@ void SCut::construct(LTreeNode* node){
 	}
 }
 
+template<typename Res>
+bool SCut::add_child(Res& res, const Res& child, cycle_t& max_time, len_t num_bgrp, bool is_seg){
+	// Update buffer usage.
+	if(num_bgrp > 1 && !(res.buf_usage += child.ifm_usage)){
+		return false;
+	}
+	if(!(res.buf_usage += child.buf_usage)){
+		return false;
+	}
+
+	// Update weight usage
+	if(!(res.wgt_usage += child.wgt_usage)){
+		return false;
+	}
+
+	// Update ifmap usage
+	if(!(is_seg || (res.ifm_usage += child.ifm_usage))){
+		return false;
+	}
+
+	// time needs to be updated at last (when max is computed)
+	// res.cost.time += child.cost.time;
+	res.cost.energy += child.cost.energy;
+	max_time = MAX(child.cost.time, max_time);
+	res.ubuf_energy += child.ubuf_energy;
+	res.buf_energy += child.buf_energy;
+	res.bus_energy += child.bus_energy;
+	res.mac_energy += child.mac_energy;
+	return true;
+}
+
+template<typename Res>
+bool SCut::finish(Res& res, cycle_t stage, lid_t num_stage, len_t num_bgrp, bool is_seg){
+	// Update and check buffer usage.
+	if(!(res.buf_usage + res.wgt_usage)){
+		return false;
+	}
+
+	res.ifm_usage.multiple(num_bgrp);
+	if(!(is_seg || res.ifm_usage)){
+		return false;
+	}
+
+	res.cost.time = stage * (num_stage + num_bgrp);
+	res.cost.energy *= num_bgrp;
+	res.ubuf_energy *= num_bgrp;
+	res.buf_energy *= num_bgrp;
+	res.bus_energy *= num_bgrp;
+	res.mac_energy *= num_bgrp;
+	return true;
+}
+
+template bool SCut::add_child<SchResult>(SchResult&, const SchResult&, cycle_t&, len_t, bool);
+template bool SCut::finish<SchResult>(SchResult&, cycle_t, lid_t, len_t, bool);
+template bool SCut::add_child<SchEval::Row>(SchEval::Row&, const SchEval::Row&, cycle_t&, len_t, bool);
+template bool SCut::finish<SchEval::Row>(SchEval::Row&, cycle_t, lid_t, len_t, bool);
+
 SCut::SCut(LTreeNode *_node, const Cluster& _c, SchNode::cut_ptr _parent)
 	:Cut(NodeType::S, _node, _c, _parent),
 	 stage(_node->get_stages()), num_stage(_node->get_num_stage()){
@@ -645,13 +814,38 @@ SchNode* SCut::copy(Cut* newParent) const{
 	return cut;
 }
 
+lid_t SCut::get_num_stage() const{
+	return num_stage;
+}
 
-/* #################### SchNode::SchCost #################### */
+cycle_t SCut::stage_time(cycle_t max_time, const NoC& noc){
+	/*
+	 * With phase_noc, all children run (and transfer data) at the same time
+	 * in each stage, so each stage is bounded by their total NoC & DRAM time.
+	 * (Children in a TCut run one by one, their own bounds are simply added.)
+	 */
+	if(phase_noc){
+		max_time = MAX(max_time, noc.get_time());
+	}
+	return max_time;
+}
+
+
+/* #################### SchResult #################### */
+
+void SchResult::reset(){
+	cost = SchCost(0, 0);
+	noc.clear();
+	buf_usage = BufferUsage();
+	ifm_usage = BufferUsage();
+	wgt_usage = BufferUsage();
+	ubuf_energy = buf_energy = bus_energy = mac_energy = 0;
+}
 
-SchNode::SchCost::SchCost(energy_t _energy, cycle_t _time)
+SchResult::SchCost::SchCost(energy_t _energy, cycle_t _time)
 	:energy(_energy),time(_time){}
 
-SchNode::SchCost&SchNode::SchCost::operator+=(const SchNode::SchCost& other){
+SchResult::SchCost& SchResult::SchCost::operator+=(const SchResult::SchCost& other){
 	if(!(isValid() && other.isValid())){
 		energy = energy_inf;
 		return *this;
@@ -661,7 +855,7 @@ SchNode::SchCost&SchNode::SchCost::operator+=(const SchNode::SchCost& other){
 	return *this;
 }
 
-SchNode::SchCost& SchNode::SchCost::operator*=(len_t other){
+SchResult::SchCost& SchResult::SchCost::operator*=(len_t other){
 	if(isValid()){
 		energy *= other;
 		time *= other;
@@ -669,21 +863,21 @@ SchNode::SchCost& SchNode::SchCost::operator*=(len_t other){
 	return *this;
 }
 
-bool SchNode::SchCost::operator!=(const SchNode::SchCost& other) const{
+bool SchResult::SchCost::operator!=(const SchResult::SchCost& other) const{
 	if(isValid() && other.isValid())
 		return energy != other.energy || time != other.time;
 	return isValid() == other.isValid();
 }
 
-bool SchNode::SchCost::isValid() const{
+bool SchResult::SchCost::isValid() const{
 	return energy < energy_inf;
 }
 
-cost_t SchNode::SchCost::cost(len_t nbatch) const{
+cost_t SchResult::SchCost::cost(len_t nbatch) const{
 	return calc_cost(energy, time*nbatch);
 }
 
-std::ostream& operator<<(std::ostream& os, const SchNode::SchCost& cost){
+std::ostream& operator<<(std::ostream& os, const SchResult::SchCost& cost){
 	return os << "E:" << cost.energy << ", T:" << cost.time << ", Cost:" << cost.cost();
 }
 
@@ -932,6 +1126,8 @@ void LNode::add_workload_and_dfs(len_t batch_offset, len_t segment, std::vector<
 				else{
 					batch_size = tot_batch;
 				}
+				// Streamed weights are fetched again in each batch group.
+				if(wgt_stream) batch_size = num_batch;
 				if(batch_offset % batch_size == 0){
 					DRAM["out"][DRAM_weight_pos[key]]["destination"].append(destination);
 				}
@@ -1442,6 +1638,8 @@ void LNode::add_workload_and_dfs(len_t batch_offset, len_t segment, std::vector<
 			else{
 				batch_size = tot_batch;
 			}
+			// Streamed weights are fetched again in each batch group.
+			if(wgt_stream) batch_size = num_batch;
 			weight["type"] = "weight";
 			weight["layer"] = layert.name();
 			weight["lower"] = range.c.from;
@@ -0,0 +1,86 @@
+#include "threadpool.h"
+
+#include <algorithm>
+
+
+ThreadPool::Job::Job(const task_func& _func, std::size_t _num)
+	: func(_func), num(_num), next(0), done(0), users(0){}
+
+ThreadPool::ThreadPool(std::size_t num_workers): stopping(false){
+	workers.reserve(num_workers);
+	for(std::size_t i = 0; i < num_workers; ++i){
+		workers.emplace_back(&ThreadPool::work, this);
+	}
+}
+
+ThreadPool::~ThreadPool(){
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	job_cv.notify_all();
+	for(auto& t: workers) t.join();
+}
+
+void ThreadPool::work(){
+	std::unique_lock<std::mutex> guard(lock);
+	while(true){
+		job_cv.wait(guard, [this]{ return stopping || !jobs.empty(); });
+		if(stopping) return;
+
+		Job* job = jobs.front();
+		++job->users;
+		guard.unlock();
+		std::size_t cnt = runTasks(*job);
+		guard.lock();
+
+		// All tasks of job are started now.
+		removeJob(job);
+		--job->users;
+		job->done += cnt;
+		if(job->done == job->num && job->users == 0) done_cv.notify_all();
+	}
+}
+
+std::size_t ThreadPool::runTasks(Job& job){
+	std::size_t cnt = 0;
+	while(true){
+		std::size_t i = job.next.fetch_add(1);
+		if(i >= job.num) break;
+		job.func(i);
+		++cnt;
+	}
+	return cnt;
+}
+
+void ThreadPool::removeJob(Job* job){
+	auto it = std::find(jobs.begin(), jobs.end(), job);
+	if(it != jobs.end()) jobs.erase(it);
+}
+
+void ThreadPool::run(std::size_t num, const task_func& func){
+	if(num == 0) return;
+	if(workers.empty() || num == 1){
+		for(std::size_t i = 0; i < num; ++i) func(i);
+		return;
+	}
+
+	Job job(func, num);
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		jobs.push_back(&job);
+	}
+	job_cv.notify_all();
+
+	std::size_t cnt = runTasks(job);
+
+	std::unique_lock<std::mutex> guard(lock);
+	removeJob(&job);
+	job.done += cnt;
+	// Workers may still hold a pointer to job, wait until they leave.
+	done_cv.wait(guard, [&job]{ return job.done == job.num && job.users == 0; });
+}
+
+std::size_t ThreadPool::size() const{
+	return workers.size() + 1;
+}
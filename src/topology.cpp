@@ -0,0 +1,153 @@
+#include "topology.h"
+
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+#include "cluster.h"
+
+
+std::vector<bool> Topology::d2d;
+bool Topology::mesh = true;
+bool Topology::hasD2D = false;
+bool Topology::torus = false;
+mlen_t Topology::express = 0;
+mlen_t Topology::chiplet_x = 0;
+mlen_t Topology::chiplet_y = 0;
+bw_t Topology::d2d_bw = 0;
+double Topology::d2d_cost = 1;
+
+// Chiplet of pos, as (x, y) index of the chiplet.
+static pos_t chiplet_of(pos_t pos){
+	pos_t chip = {0, 0};
+	if(Topology::chiplet_x > 0) chip.x = pos.x / Topology::chiplet_x;
+	if(Topology::chiplet_y > 0) chip.y = pos.y / Topology::chiplet_y;
+	return chip;
+}
+
+void Topology::init(){
+	if(express < 0 || express == 1 || express >= MAX(Cluster::xlen, Cluster::ylen)){
+		throw std::invalid_argument("express should be 0 or in [2, mesh size)!");
+	}
+	if(chiplet_x < 0 || chiplet_y < 0){
+		throw std::invalid_argument("Chiplet size should not be negative!");
+	}
+	hasD2D = (chiplet_x > 0 && chiplet_x < Cluster::xlen) || (chiplet_y > 0 && chiplet_y < Cluster::ylen);
+	mesh = !torus && express == 0 && !hasD2D;
+	if(hasD2D && (d2d_bw == 0 || d2d_cost < 0)){
+		throw std::invalid_argument("D2D links need positive d2d_bw and non-negative d2d_cost!");
+	}
+
+	d2d.assign(num_links(), false);
+	if(!has_d2d()) return;
+	for(mlen_t x = 0; x < Cluster::xlen; ++x){
+		for(mlen_t y = 0; y < Cluster::ylen; ++y){
+			for(mlen_t dir = 0; dir < num_dirs(); ++dir){
+				pos_t to = link_to(x, y, dir);
+				// Skip links that do not exist.
+				if(to.x < 0 || to.x >= Cluster::xlen || to.y < 0 || to.y >= Cluster::ylen) continue;
+				if(dir >= 4 && ((dir % 2 == 0) ? x : y) % express != 0) continue;
+				pos_t fromChip = chiplet_of({x, y}), toChip = chiplet_of(to);
+				d2d[link_idx(x, y, dir)] = (fromChip.x != toChip.x || fromChip.y != toChip.y);
+			}
+		}
+	}
+}
+
+bool Topology::is_mesh(){
+	return mesh;
+}
+
+bool Topology::has_d2d(){
+	return hasD2D;
+}
+
+mlen_t Topology::num_dirs(){
+	return (express > 0) ? 8 : 4;
+}
+
+std::int32_t Topology::num_links(){
+	return static_cast<std::int32_t>(num_dirs()) * Cluster::xlen * Cluster::ylen;
+}
+
+std::int32_t Topology::link_idx(mlen_t x, mlen_t y, mlen_t dir){
+	return (static_cast<std::int32_t>(x) * Cluster::ylen + y) * num_dirs() + dir;
+}
+
+void Topology::link_pos(std::int32_t link_idx, mlen_t& x, mlen_t& y, mlen_t& dir){
+	dir = static_cast<mlen_t>(link_idx % num_dirs());
+	link_idx /= num_dirs();
+	y = static_cast<mlen_t>(link_idx % Cluster::ylen);
+	x = static_cast<mlen_t>(link_idx / Cluster::ylen);
+}
+
+bool Topology::is_d2d(std::int32_t link_idx){
+	return d2d[link_idx];
+}
+
+pos_t Topology::link_to(mlen_t x, mlen_t y, mlen_t dir){
+	int step = (dir >= 4) ? express : 1;
+	int tx = x, ty = y;
+	switch(dir % 4){
+	case 0: tx += step;
+		break;
+	case 1: ty -= step;
+		break;
+	case 2: tx -= step;
+		break;
+	case 3: ty += step;
+		break;
+	}
+	if(torus && dir < 4){
+		tx = (tx + Cluster::xlen) % Cluster::xlen;
+		ty = (ty + Cluster::ylen) % Cluster::ylen;
+	}
+	return {static_cast<mlen_t>(tx), static_cast<mlen_t>(ty)};
+}
+
+int Topology::offset(mlen_t a, mlen_t b, mlen_t len){
+	int d = b - a;
+	if(!torus) return d;
+	d = (d + len) % len;
+	if(2 * d > len) d -= len;
+	return d;
+}
+
+bool Topology::express_span(int a, int b, int& e0, int& e1){
+	if(express == 0) return false;
+	e0 = DIVCEIL(a, express) * express;
+	e1 = b / express * express;
+	return e0 < e1;
+}
+
+// #hops of a straight path from p by delta.
+static int line_hops(int p, int delta, mlen_t len){
+	int a = MIN(p, p + delta), b = MAX(p, p + delta);
+	int e0, e1;
+	// Express links never wrap around.
+	if(a < 0 || b >= len || !Topology::express_span(a, b, e0, e1)) return std::abs(delta);
+	return (e0 - a) + (b - e1) + (e1 - e0) / Topology::express;
+}
+
+int Topology::distance(pos_t a, pos_t b){
+	if(is_mesh()) return std::abs(a.x - b.x) + std::abs(a.y - b.y);
+	return line_hops(a.x, offset(a.x, b.x, Cluster::xlen), Cluster::xlen)
+		 + line_hops(a.y, offset(a.y, b.y, Cluster::ylen), Cluster::ylen);
+}
+
+int Topology::count_d2d(int from, int to, bool fwd, mlen_t len, mlen_t chip){
+	if(chip <= 0 || chip >= len || from > to) return 0;
+	int cnt = 0;
+	if(fwd){
+		// Link q -> q+1 is D2D if (q+1) is a multiple of chip, and link len-1 -> 0 wraps around.
+		int lo = from + 1, hi = MIN(to + 1, len - 1);
+		if(lo <= hi) cnt = hi / chip - (lo - 1) / chip;
+		if(to == len - 1 && (len - 1) / chip != 0) ++cnt;
+	}else{
+		// Link q -> q-1 is D2D if q is a multiple of chip, and link 0 -> len-1 wraps around.
+		int lo = MAX(from, 1);
+		if(lo <= to) cnt = to / chip - (lo - 1) / chip;
+		if(from == 0 && (len - 1) / chip != 0) ++cnt;
+	}
+	return cnt;
+}
@@ -45,10 +45,14 @@ cost_t calc_cost(energy_t energy, cycle_t time){
 
 len_t* part_intv(len_t tot_len, len_t ncuts){
 	len_t* arr = new len_t[ncuts+1];
+	part_intv(tot_len, ncuts, arr);
+	return arr;
+}
+
+void part_intv(len_t tot_len, len_t ncuts, len_t* arr){
 	for (len_t i=0; i<=ncuts; ++i) {
 		arr[i] = tot_len - (tot_len * (ncuts-i)) / ncuts;
 	}
-	return arr;
 }
 
 
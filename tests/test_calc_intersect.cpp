@@ -0,0 +1,72 @@
+/*
+ * NoC::calc_intersect counts the batch overlap of two ranges with different
+ * batch sizes in closed form (periodic_overlap). It must give the same
+ * volume as the loop over all batch groups of the smaller batch.
+ *
+ * Checked over all ranges with small batch sizes.
+ */
+
+#include "test_util.h"
+
+// The loop over batch groups of the smaller batch, as before the closed form.
+static vol_t loop_intersect(const fmap_range& rng1, const fmap_range& rng2, len_t bat1, len_t bat2){
+	fmap_range ints = rng1.intersect(rng2);
+	if(bat1 == bat2) return ints.size();
+
+	len_t sb_st, sb_ed, lb_st, lb_ed, tot_b=0;
+	if(bat1 > bat2){
+		sb_st = rng2.b.from;
+		sb_ed = rng2.b.to;
+		lb_st = rng1.b.from;
+		lb_ed = rng1.b.to;
+		for(;sb_st < lb_ed; sb_st+=bat2, sb_ed+=bat2){
+			if(sb_ed <= lb_st) continue;
+			tot_b += MIN(sb_ed, lb_ed) - MAX(sb_st, lb_st);
+		}
+	}else{
+		sb_st = rng1.b.from;
+		sb_ed = rng1.b.to;
+		lb_st = rng2.b.from;
+		lb_ed = rng2.b.to;
+		for(;sb_st < lb_ed; sb_st+=bat1, sb_ed+=bat1){
+			if(sb_ed <= lb_st) continue;
+			tot_b += MIN(sb_ed, lb_ed) - MAX(sb_st, lb_st);
+		}
+	}
+	ints.b.from=0;
+	ints.b.to=tot_b;
+	vol_t v = ints.size();
+	if(bat1 > bat2)  v /= (bat1 / bat2);
+	return v;
+}
+
+// A range of 3 channels, 2 rows and 1 column in batches [from, to).
+static fmap_range make_range(len_t from, len_t to){
+	return fmap_range({0, 3}, {from, to}, {0, 2}, {0, 1});
+}
+
+int main(){
+	int num_checks = 0;
+	for(len_t small_b = 1; small_b <= 4; ++small_b){
+		for(len_t mult = 1; mult <= 4; ++mult){
+			const len_t large_b = small_b * mult;
+			for(len_t st = 0; st <= small_b; ++st){
+				for(len_t ed = st; ed <= small_b; ++ed){
+					const fmap_range small_rng = make_range(st, ed);
+					for(len_t from = 0; from <= large_b; ++from){
+						for(len_t to = from; to <= large_b; ++to){
+							const fmap_range large_rng = make_range(from, to);
+							CHECK(NoC::calc_intersect(large_rng, small_rng, large_b, small_b) ==
+								loop_intersect(large_rng, small_rng, large_b, small_b));
+							CHECK(NoC::calc_intersect(small_rng, large_rng, small_b, large_b) ==
+								loop_intersect(small_rng, large_rng, small_b, large_b));
+							++num_checks;
+						}
+					}
+				}
+			}
+		}
+	}
+	CHECK(num_checks > 0);
+	return 0;
+}
@@ -0,0 +1,168 @@
+/*
+ * NoC::HopCount adds straight paths into difference arrays (add_line), which
+ * are moved into link_hops by flush(). This must give the same link_hops as
+ * adding each link of the path (add).
+ *
+ * Checked with random lines and links on meshes of different sizes, with
+ * and without torus and express links, and with the routes of NoC::get_route
+ * (which wrap around and take express links) against a walk over their links.
+ */
+
+#include "test_util.h"
+
+#include <map>
+#include <random>
+
+typedef NoC::HopCount HopCount;
+typedef std::int32_t linkIdx_t;
+
+// Checks that *h* and *ref* have the same #hops on all links.
+static void check_same(const HopCount& h, const HopCount& ref){
+	for(linkIdx_t i = 0; i < HopCount::num_links(); ++i){
+		CHECK(h.get(i) == ref.get(i));
+	}
+	CHECK(h.max() == ref.max());
+}
+
+// Adds links [from, to] to direction dir one by one.
+static void add_links(HopCount& h, pos_t pos, mlen_t dir, int from, int to, NoC::hop_t size){
+	mlen_t& c = (dir % 2 == 0) ? pos.x : pos.y;
+	for(int i = from; i <= to; ++i){
+		c = static_cast<mlen_t>(i);
+		h.add(HopCount::get_idx(pos.x, pos.y, dir), size);
+	}
+}
+
+static void check_random_lines(std::mt19937& rng){
+	auto rand_int = [&](int lo, int hi){
+		return std::uniform_int_distribution<int>(lo, hi)(rng);
+	};
+	auto rand_pos = [&]() -> pos_t{
+		return {static_cast<mlen_t>(rand_int(0, Cluster::xlen - 1)), static_cast<mlen_t>(rand_int(0, Cluster::ylen - 1))};
+	};
+
+	HopCount h[2], ref[2];
+	for(int t = 0; t < 2000; ++t){
+		const int k = rand_int(0, 1);
+		const NoC::hop_t size = rand_int(1, 100);
+		if(rand_int(0, 3) == 0){
+			// One link, also express ones.
+			const linkIdx_t idx = rand_int(0, HopCount::num_links() - 1);
+			h[k].add(idx, size);
+			ref[k].add(idx, size);
+		}else{
+			const pos_t pos = rand_pos();
+			const mlen_t dir = static_cast<mlen_t>(rand_int(0, 3));
+			const int len = (dir % 2 == 0) ? Cluster::xlen : Cluster::ylen;
+			int from = rand_int(0, len - 1), to = rand_int(0, len - 1);
+			if(from > to) std::swap(from, to);
+			h[k].add_line(pos, dir, from, to, size);
+			add_links(ref[k], pos, dir, from, to, size);
+		}
+
+		// Reads in between, with lines still pending.
+		if(t % 97 == 0){
+			const pos_t pos = rand_pos();
+			const mlen_t dir = static_cast<mlen_t>(rand_int(0, 3));
+			const int len = (dir % 2 == 0) ? Cluster::xlen : Cluster::ylen;
+			CHECK(h[k].line_max(pos, dir, 0, len - 1) == ref[k].line_max(pos, dir, 0, len - 1));
+		}
+		if(t % 499 == 0) check_same(h[k], ref[k]);
+	}
+	check_same(h[0], ref[0]);
+	check_same(h[1], ref[1]);
+
+	// Sum and product with pending lines.
+	h[0].add_line({0, 0}, 0, 0, Cluster::xlen - 1, 7);
+	add_links(ref[0], {0, 0}, 0, 0, Cluster::xlen - 1, 7);
+	h[1].add_line({0, 0}, 3, 0, Cluster::ylen - 1, 5);
+	add_links(ref[1], {0, 0}, 3, 0, Cluster::ylen - 1, 5);
+	h[0] += h[1];
+	ref[0] += ref[1];
+	check_same(h[0], ref[0]);
+	h[0] *= 3;
+	ref[0] *= 3;
+	check_same(h[0], ref[0]);
+}
+
+// Adds the route of a straight path from *pos* by *delta*, one link at a time.
+static void walk_line(pos_t& pos, bool alongX, int delta, std::map<linkIdx_t, double>& links){
+	if(delta == 0) return;
+	const int len = alongX ? Cluster::xlen : Cluster::ylen;
+	const bool fwd = (delta > 0);
+	const mlen_t dir = alongX ? (fwd ? 0 : 2) : (fwd ? 3 : 1);
+	const int p = alongX ? pos.x : pos.y, q = p + delta;
+	int e0 = 0, e1 = 0;
+	// Express links between e0 and e1, if the path does not wrap around.
+	const bool express = (q >= 0 && q < len && Topology::express_span(MIN(p, q), MAX(p, q), e0, e1));
+	const int exp_from = fwd ? e0 : e1, exp_to = fwd ? e1 : e0;
+
+	int cur = p;
+	for(int n = 0; cur != (q + len) % len; ++n){
+		CHECK(n < len);
+		const bool take_express = express && cur == exp_from;
+		const mlen_t d = static_cast<mlen_t>(take_express ? dir + 4 : dir);
+		while(true){
+			links[Topology::link_idx(pos.x, pos.y, d)] += 1;
+			pos = Topology::link_to(pos.x, pos.y, d);
+			cur = alongX ? pos.x : pos.y;
+			if(!take_express || cur == exp_to) break;
+		}
+	}
+}
+
+// Compares the routes of NoC::get_route (XY) with walk_line.
+static void check_routes(){
+	std::vector<std::pair<linkIdx_t, double>> route;
+	for(mlen_t sx = 0; sx < Cluster::xlen; ++sx){
+		for(mlen_t sy = 0; sy < Cluster::ylen; ++sy){
+			for(mlen_t dx = 0; dx < Cluster::xlen; ++dx){
+				for(mlen_t dy = 0; dy < Cluster::ylen; ++dy){
+					const pos_t src = {sx, sy}, dst = {dx, dy};
+					NoC::get_route(src, &dst, 1, NoC::Routing::XY, route);
+
+					std::map<linkIdx_t, double> ref;
+					pos_t cur = src;
+					walk_line(cur, true, Topology::offset(src.x, dst.x, Cluster::xlen), ref);
+					walk_line(cur, false, Topology::offset(src.y, dst.y, Cluster::ylen), ref);
+					CHECK(cur.x == dst.x && cur.y == dst.y);
+
+					CHECK(route.size() == ref.size());
+					for(const auto& link: route){
+						auto it = ref.find(link.first);
+						CHECK(it != ref.end() && it->second == link.second);
+					}
+				}
+			}
+		}
+	}
+}
+
+int main(){
+	std::mt19937 rng(1);
+
+	struct Config{
+		mlen_t xlen, ylen;
+		bool torus;
+		mlen_t express;
+	};
+	const Config configs[] = {
+		{4, 4, false, 0},
+		{5, 3, false, 0},
+		{5, 4, true, 0},
+		{5, 4, false, 2},
+		{7, 5, true, 2},
+		{8, 6, true, 3},
+	};
+	for(const Config& cfg: configs){
+		Cluster::xlen = cfg.xlen;
+		Cluster::ylen = cfg.ylen;
+		Topology::torus = cfg.torus;
+		Topology::express = cfg.express;
+		Topology::init();
+
+		check_random_lines(rng);
+		check_routes();
+	}
+	return 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * With phase_noc, each stage of an SCut is bounded by the NoC & DRAM time of
+ * all its children (SCut::stage_time). SchEval must apply the same bound,
+ * i.e. the cost of the root is the same in SchEval and in the tree.
+ *
+ * Darknet19 on 4*4 cores, with layers [from, to) pipelined in an SCut.
+ */
+
+#include "test_util.h"
+
+#include "ltreenode.h"
+#include "scheval.h"
+
+// Checks the root cost of the tree with layers [from, to) in an SCut of *bgrp* batch groups.
+// Returns whether the scheme is valid.
+static bool check_scut(const Cluster& c, lid_t from, lid_t to, len_t bgrp){
+	const len_t batch = SchNode::tot_batch;
+	LTreeNode* root = new LTreeNode(Bitset(), batch, nullptr, LTreeNode::NodeType::T);
+	for(lid_t i = 0; i < from; ++i) (void)new LTreeNode(i, batch, root);
+	LTreeNode* cut = new LTreeNode(Bitset(), batch, root, LTreeNode::NodeType::S);
+	for(lid_t i = from; i < to; ++i) (void)new LTreeNode(i, batch / bgrp, cut);
+	for(lid_t i = to; i < network->len(); ++i) (void)new LTreeNode(i, batch, root);
+	root->init_root();
+
+	SchNode* sch = SchNode::newNode(root, c, nullptr);
+	bool valid = sch->is_valid();
+	if(valid){
+		SchEval eval(sch);
+		CHECK(eval.eval());
+		SchNode::SchCost cost = eval.get_cost(eval.root());
+		CHECK(cost.energy == sch->get_cost().energy);
+		CHECK(cost.time == sch->get_cost().time);
+	}
+	delete sch;
+	delete root;
+	return valid;
+}
+
+int main(){
+	TestEnv env(darknet19, 8, 4, 4);
+	Cluster c = env.all_cores();
+	SchNode::phase_noc = true;
+
+	int num_valid = 0;
+	for(lid_t from = 0; from + 3 <= network->len(); from += 3){
+		for(len_t bgrp: {1, 2, 4}){
+			num_valid += check_scut(c, from, from + 3, bgrp);
+		}
+	}
+	CHECK(num_valid > 0);
+	return 0;
+}
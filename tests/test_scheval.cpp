@@ -0,0 +1,148 @@
+/*
+ * SchEval re-aggregates a tree from the results of its LNodes, in flat
+ * per-node arrays. Each node must get the same results as the SchNode tree
+ * built by construct(): validity, cost, energies, max buffer usage, and
+ * the NoC of each segment and of the root.
+ *
+ * Darknet19 on 4*4 cores, with segments of LNodes, TCuts, SCuts and nested
+ * cuts with different #bgrp, with and without phase_noc.
+ */
+
+#include "test_util.h"
+
+#include <cmath>
+#include <random>
+
+#include "ltreenode.h"
+#include "scheval.h"
+
+// Kinds of segments of layers [from, to).
+enum class Seg{
+	L,		// One segment per layer.
+	T,		// TCut of all layers.
+	S,		// SCut of all layers.
+	ST,		// SCut of a TCut (the first layers) and the last layer.
+	TS,		// TCut of an SCut (the first layers) and the last layer.
+};
+
+// Adds layers [from, to) to *parent* as a segment of kind *seg*.
+static void add_segment(LTreeNode* parent, lid_t from, lid_t to, Seg seg, len_t bgrp){
+	const len_t batch = SchNode::tot_batch;
+	if(seg == Seg::L || to - from < 2){
+		for(lid_t i = from; i < to; ++i) (void)new LTreeNode(i, batch, parent);
+		return;
+	}
+	const bool outer_s = (seg == Seg::S || seg == Seg::ST);
+	LTreeNode* cut = new LTreeNode(Bitset(), batch, parent, outer_s ? LTreeNode::NodeType::S : LTreeNode::NodeType::T);
+	const len_t sub = batch / bgrp;
+	// Inner cuts have at least two layers.
+	if(seg == Seg::T || seg == Seg::S || to - from < 3){
+		for(lid_t i = from; i < to; ++i) (void)new LTreeNode(i, sub, cut);
+		return;
+	}
+	LTreeNode* inner = new LTreeNode(Bitset(), sub, cut, outer_s ? LTreeNode::NodeType::T : LTreeNode::NodeType::S);
+	for(lid_t i = from; i + 1 < to; ++i) (void)new LTreeNode(i, sub, inner);
+	(void)new LTreeNode(to - 1, sub, cut);
+}
+
+// All nodes of *node* in post-order, the order of SchEval ids.
+static void post_order(const SchNode* node, std::vector<const SchNode*>& nodes){
+	if(node->get_type() != SchNode::NodeType::L){
+		for(const SchNode* child: static_cast<const Cut*>(node)->getChildren()){
+			post_order(child, nodes);
+		}
+	}
+	nodes.push_back(node);
+}
+
+static bool near(double a, double b){
+	return std::abs(a - b) <= 1e-9 * MAX(std::abs(a), std::abs(b));
+}
+
+static void check_noc(const NoC& a, const NoC& b){
+	CHECK(a.get_tot_hops() == b.get_tot_hops());
+	CHECK(a.get_time() == b.get_time());
+	CHECK(near(a.get_cost(), b.get_cost()));
+}
+
+// Compares SchEval with the tree of *root*, returns whether the scheme is valid.
+static bool check_tree(const Cluster& c, LTreeNode* root){
+	root->init_root();
+	SchNode* sch = SchNode::newNode(root, c, nullptr);
+
+	SchEval eval(sch);
+	CHECK(eval.eval() == sch->is_valid());
+
+	std::vector<const SchNode*> nodes;
+	post_order(sch, nodes);
+	CHECK(nodes.size() == eval.size());
+	for(SchEval::nid_t id = 0; id < eval.size(); ++id){
+		const SchNode* node = nodes[id];
+		CHECK(eval.get_type(id) == node->get_type());
+		CHECK(eval.is_valid(id) == node->is_valid());
+		if(!node->is_valid()) continue;
+		CHECK(eval.get_cost(id).energy == node->get_cost().energy);
+		CHECK(eval.get_cost(id).time == node->get_cost().time);
+		CHECK(eval.get_ubuf_energy(id) == node->get_ubuf_energy());
+		CHECK(eval.get_buf_energy(id) == node->get_buf_energy());
+		CHECK(eval.get_bus_energy(id) == node->get_bus_energy());
+		CHECK(eval.get_mac_energy(id) == node->get_mac_energy());
+		CHECK(eval.get_max_buf(id) == node->get_buf_usage().max());
+		if(eval.get_noc(id) != nullptr){
+			check_noc(*eval.get_noc(id), node->get_noc());
+		}
+	}
+
+	const bool valid = sch->is_valid();
+	delete sch;
+	delete root;
+	return valid;
+}
+
+// All layers in segments of kind *seg*, three layers per segment.
+static LTreeNode* same_tree(Seg seg, len_t bgrp){
+	LTreeNode* root = new LTreeNode(Bitset(), SchNode::tot_batch, nullptr, LTreeNode::NodeType::T);
+	for(lid_t from = 0; from < network->len(); from += 3){
+		add_segment(root, from, MIN(from + 3, network->len()), seg, bgrp);
+	}
+	return root;
+}
+
+// Segments of random kinds, lengths and #bgrp.
+static LTreeNode* random_tree(std::mt19937& rng){
+	auto rand_int = [&](int lo, int hi){
+		return std::uniform_int_distribution<int>(lo, hi)(rng);
+	};
+	LTreeNode* root = new LTreeNode(Bitset(), SchNode::tot_batch, nullptr, LTreeNode::NodeType::T);
+	for(lid_t from = 0; from < network->len();){
+		const lid_t len = static_cast<lid_t>(rand_int(1, 5));
+		const lid_t to = MIN(from + len, network->len());
+		add_segment(root, from, to, static_cast<Seg>(rand_int(0, 4)), 1 << rand_int(0, 2));
+		from = to;
+	}
+	return root;
+}
+
+int main(){
+	TestEnv env(darknet19, 8, 4, 4);
+	Cluster c = env.all_cores();
+	std::mt19937 rng(1);
+
+	for(bool phase_noc: {false, true}){
+		SchNode::phase_noc = phase_noc;
+		int num_valid = 0;
+		for(Seg seg: {Seg::L, Seg::T, Seg::S, Seg::ST, Seg::TS}){
+			for(len_t bgrp: {1, 2, 4}){
+				num_valid += check_tree(c, same_tree(seg, bgrp));
+			}
+		}
+		for(int t = 0; t < 20; ++t){
+			num_valid += check_tree(c, random_tree(rng));
+		}
+		CHECK(num_valid > 0);
+	}
+
+	// A single layer as the root.
+	(void)check_tree(c, new LTreeNode(0, SchNode::tot_batch, nullptr));
+	return 0;
+}
@@ -0,0 +1,118 @@
+/*
+ * Routing on torus, express and chiplet topologies (Topology and NoC).
+ *
+ * Topology::count_d2d must count the same D2D links as a walk over all
+ * links, and in each NoC the hops on all links must add up to tot_hops
+ * (and the hop energy must match the D2D links the hops are on).
+ *
+ * Darknet19 on 4*4 cores, with all layers as segments of the root.
+ */
+
+#include "test_util.h"
+
+#include <cmath>
+
+#include "ltreenode.h"
+
+// Chiplet of position p, in a dimension with chiplets of *chip* cores.
+static int chip_of(int p, mlen_t chip){
+	return (chip <= 0) ? 0 : p / chip;
+}
+
+// Counts D2D links at [from, to] one by one (see Topology::count_d2d).
+static int walk_d2d(int from, int to, bool fwd, mlen_t len, mlen_t chip){
+	int cnt = 0;
+	for(int q = from; q <= to; ++q){
+		int next = (q + (fwd ? 1 : len - 1)) % len;
+		cnt += (chip_of(q, chip) != chip_of(next, chip));
+	}
+	return cnt;
+}
+
+static void check_count_d2d(){
+	for(mlen_t len = 2; len <= 8; ++len){
+		for(mlen_t chip = 0; chip <= len; ++chip){
+			for(int from = 0; from < len; ++from){
+				for(int to = from; to < len; ++to){
+					for(bool fwd: {true, false}){
+						CHECK(Topology::count_d2d(from, to, fwd, len, chip) == walk_d2d(from, to, fwd, len, chip));
+					}
+				}
+			}
+		}
+	}
+
+	// 4 cores in chiplets of 2: links 1->2 and 3->0 (E), 2->1 and 0->3 (W) are D2D.
+	CHECK(Topology::count_d2d(0, 3, true, 4, 2) == 2);
+	CHECK(Topology::count_d2d(0, 1, true, 4, 2) == 1);
+	CHECK(Topology::count_d2d(2, 2, true, 4, 2) == 0);
+	CHECK(Topology::count_d2d(0, 3, false, 4, 2) == 2);
+	CHECK(Topology::count_d2d(1, 2, false, 4, 2) == 1);
+	CHECK(Topology::count_d2d(0, 0, false, 4, 2) == 1);
+	// One chiplet: no D2D links.
+	CHECK(Topology::count_d2d(0, 3, true, 4, 4) == 0);
+	CHECK(Topology::count_d2d(0, 3, true, 4, 0) == 0);
+}
+
+// Checks the link hops of all layers, returns the number of layers checked.
+static int check_noc(const Cluster& c){
+	const len_t batch = SchNode::tot_batch;
+	LTreeNode* root = new LTreeNode(Bitset(), batch, nullptr, LTreeNode::NodeType::T);
+	for(lid_t i = 0; i < network->len(); ++i) (void)new LTreeNode(i, batch, root);
+	root->init_root();
+
+	int num_checked = 0;
+	SchNode* sch = SchNode::newNode(root, c, nullptr);
+	for(const SchNode* child: static_cast<const Cut*>(sch)->getChildren()){
+		if(!child->is_valid()) continue;
+		const NoC& noc = child->get_noc();
+		NoC::hop_t tot = 0;
+		double energy = 0;
+		for(const auto& link: noc.get_link_info()){
+			tot += link.total_hops;
+			energy += link.total_hops * NoC::hop_cost * (link.d2d ? Topology::d2d_cost : 1);
+		}
+		CHECK(tot == noc.get_tot_hops());
+		CHECK(std::abs(energy - noc.get_hop_cost()) <= 1e-9 * MAX(energy, 1.0));
+		++num_checked;
+	}
+	delete sch;
+	delete root;
+	return num_checked;
+}
+
+int main(){
+	check_count_d2d();
+
+	TestEnv env(darknet19, 4, 4, 4);
+	Cluster c = env.all_cores();
+	Topology::d2d_cost = 4;
+
+	struct Config{
+		bool torus;
+		mlen_t express, chiplet_x, chiplet_y;
+		bool steiner;
+	};
+	const Config configs[] = {
+		{false, 0, 0, 0, false},
+		{true, 0, 0, 0, false},
+		{false, 2, 0, 0, false},
+		{false, 0, 2, 2, false},
+		{false, 0, 2, 4, true},
+		{true, 2, 2, 2, false},
+		{true, 2, 2, 2, true},
+	};
+	for(const Config& cfg: configs){
+		Topology::torus = cfg.torus;
+		Topology::express = cfg.express;
+		Topology::chiplet_x = cfg.chiplet_x;
+		Topology::chiplet_y = cfg.chiplet_y;
+		Topology::init();
+		NoC::steiner = cfg.steiner;
+		for(std::uint8_t mask: {1, 15}){
+			NoC::routing_mask = mask;
+			CHECK(check_noc(c) > 0);
+		}
+	}
+	return 0;
+}
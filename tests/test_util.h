@@ -0,0 +1,109 @@
+/* This file contains
+ *	CHECK:   Checks a condition in a test, and fails the test if not.
+ *	TestEnv: The global setup of stschedule (see main.cpp) for tests.
+ *
+ * Each test is a program in tests/, built and run by "make test".
+ * A test passes if it returns 0.
+ */
+
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "cluster.h"
+#include "core.h"
+#include "coremapping.h"
+#include "layerengine.h"
+#include "layertable.h"
+#include "network.h"
+#include "nns/nns.h"
+#include "noc.h"
+#include "schnode.h"
+#include "topology.h"
+#include "util.h"
+
+#define CHECK(cond) do{ \
+	if(!(cond)){ \
+		std::cerr << __FILE__ << ':' << __LINE__ << ": CHECK(" #cond ") failed." << std::endl; \
+		std::exit(1); \
+	} \
+}while(false)
+
+
+// Polar cores on an xlen * ylen mesh, with the default NoC and DRAM of main.cpp.
+class TestEnv{
+	PolarCore* core;
+	PolarMapper* mapper;
+	StdLayerEngine engine;
+
+	static PolarCore* new_core(){
+		PolarCore::PESetting pPE(8, 8, 0.018);
+		PolarCore::Bus pBus(4, 4, 0.018, 16);
+		PolarCore::Buffers pBuf;
+		pBuf.al1.Size = 8 * 1024;
+		pBuf.ol1.Size = 2 * 1024;
+		pBuf.wl1.Size = 4 * 1024;
+		pBuf.ol2.Size = 28 * 1024;
+		pBuf.wl2.Size = 0;
+		pBuf.ul3.Size = 1024 * 1024;
+		pBuf.al2.Size = 0;
+		pBuf.al1.RCost = 0.0485625 * 8;
+		pBuf.al1.WCost = 0.0411625 * 8;
+		pBuf.wl1.RCost = 0.0381625 * 8;
+		pBuf.wl1.WCost = 0.0308875 * 8;
+		pBuf.ol1.RCost = 0.0802 * 8;
+		pBuf.ol1.WCost = 0.0709 * 8;
+		pBuf.ol2.RCost = 0.07648125 * 8;
+		pBuf.ol2.WCost = 0.0989875 * 8;
+		pBuf.ul3.RCost = 0.1317125 * 8;
+		pBuf.ul3.WCost = 0.234025 * 8;
+		pBuf.al2.RCost = pBuf.al2.WCost = 0;
+		pBuf.wl2.RCost = pBuf.wl2.WCost = 0;
+		return new PolarCore(pPE, 64, 0.0873, pBus, pBuf);
+	}
+
+public:
+	TestEnv(const Network& net, len_t tot_batch, mlen_t xlen, mlen_t ylen)
+		:core(new_core()), mapper(new PolarMapper(*core)), engine(mapper){
+		SchNode::layerMapper = &engine;
+
+		Cluster::xlen = xlen;
+		Cluster::ylen = ylen;
+		Cluster::stride = 1;
+		NoC::dram_list.resize(2 * ylen);
+		for(mlen_t y = 0; y < ylen; ++y){
+			NoC::dram_list[y] = {0, y};
+			NoC::dram_list[ylen + y] = {static_cast<mlen_t>(xlen - 1), y};
+		}
+		double tops = 2.0 * core->mac_num * xlen * ylen / 1024;
+		NoC::DRAM_bw = static_cast<bw_t>(0.5 * tops);
+		NoC::NoC_bw = 24;
+		NoC::DRAM_acc_cost = 7.5 * 8;
+		NoC::hop_cost = 0.7 * 8;
+		Topology::d2d_bw = 6;
+		Topology::init();
+
+		network = &net;
+		SchNode::tot_batch = tot_batch;
+		network->set_utime(*mapper);
+		layerTable.init(xlen * ylen, tot_batch, core->ubuf().Size);
+	}
+
+	TestEnv(const TestEnv&) = delete;
+	TestEnv& operator=(const TestEnv&) = delete;
+
+	~TestEnv(){
+		delete mapper;
+		delete core;
+	}
+
+	// The cluster of the whole mesh.
+	Cluster all_cores() const{
+		return Cluster(0, Cluster::xlen * Cluster::ylen);
+	}
+};
+
+#endif // TEST_UTIL_H
@@ -0,0 +1,41 @@
+/*
+ * Weights of streamed layers (wgt_stream) are stored with ifmap, so they
+ * must not count as pinned weights of their cut (Cut::pinnedWgtFits).
+ *
+ * Darknet19 on 3*3 cores: the weights of layers 18-21 (about 10.5M) don't
+ * fit in the buffers of all cores (9 * 1MB). In a segment of two batch groups,
+ * they are invalid when pinned, but valid when streamed.
+ */
+
+#include "test_util.h"
+
+#include "ltreenode.h"
+
+// Whether the scheme is valid, with layers [from, to) in a TCut of two batch groups.
+static bool is_valid(const Cluster& c, lid_t from, lid_t to, bool stream){
+	const len_t batch = SchNode::tot_batch;
+	LTreeNode* root = new LTreeNode(Bitset(), batch, nullptr, LTreeNode::NodeType::T);
+	for(lid_t i = 0; i < from; ++i) (void)new LTreeNode(i, batch, root);
+	LTreeNode* cut = new LTreeNode(Bitset(), batch, root, LTreeNode::NodeType::T);
+	for(lid_t i = from; i < to; ++i){
+		LTreeNode* lnode = new LTreeNode(i, batch / 2, cut);
+		if(stream && !network->getNode(i).hasWgtPrevs()) lnode->set_wgt_stream(true);
+	}
+	for(lid_t i = to; i < network->len(); ++i) (void)new LTreeNode(i, batch, root);
+	root->init_root();
+
+	SchNode* sch = SchNode::newNode(root, c, nullptr);
+	bool valid = sch->is_valid();
+	delete sch;
+	delete root;
+	return valid;
+}
+
+int main(){
+	TestEnv env(darknet19, 4, 3, 3);
+	Cluster c = env.all_cores();
+
+	CHECK(!is_valid(c, 18, 22, false));
+	CHECK(is_valid(c, 18, 22, true));
+	return 0;
+}
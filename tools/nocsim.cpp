@@ -0,0 +1,71 @@
+/*
+ * nocsim: Replays a chiplet trace (*_chiplet_trace.txt) with NoCSim.
+ *
+ * Usage: nocsim trace_file noc_bw dram_bw [channels] [max_sends]
+ *
+ *   noc_bw, dram_bw: bandwidth of each link and of all DRAM ports (#data / cycle).
+ *   channels:        buffers of each link (0: unlimited, default).
+ *   max_sends:       running SENDs of each chiplet (0: unlimited, default).
+ *
+ * The mesh size is read from the trace, with a plain mesh and DRAM ports on
+ * the left and right columns (the default of stschedule). Each data is
+ * 8 bytes, as in the trace. Prints the simulated time and the busiest
+ * resources, and writes the occupancy CSV to trace_file + ".nocsim.csv".
+ */
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "chiplet_trace.h"
+#include "cluster.h"
+#include "noc.h"
+#include "nocsim.h"
+#include "topology.h"
+
+int main(int argc, char **argv) {
+  if (argc < 4 || argc > 6) {
+    std::cerr << "Usage: " << argv[0]
+              << " trace_file noc_bw dram_bw [channels] [max_sends]"
+              << std::endl;
+    return 1;
+  }
+
+  const std::string trace_name = argv[1];
+  const int noc_bw = std::stoi(argv[2]);
+  const int dram_bw = std::stoi(argv[3]);
+  const int channels = (argc > 4) ? std::stoi(argv[4]) : 0;
+  const int max_sends = (argc > 5) ? std::stoi(argv[5]) : 0;
+  if (noc_bw <= 0 || dram_bw <= 0 || channels < 0 || max_sends < 0) {
+    std::cerr << "Bandwidth should be positive, channels and max_sends "
+                 "should be non-negative!"
+              << std::endl;
+    return 1;
+  }
+
+  std::ifstream in(trace_name);
+  if (!in) {
+    std::cerr << "Cannot open trace \"" << trace_name << "\"!" << std::endl;
+    return 1;
+  }
+  ChipletTrace::FullTrace trace;
+  trace.read(in);
+
+  Cluster::xlen = trace.mesh_x;
+  Cluster::ylen = trace.mesh_y;
+  NoC::NoC_bw = noc_bw;
+  NoC::DRAM_bw = dram_bw;
+  NoC::dram_list.resize(2 * trace.mesh_y);
+  for (mlen_t y = 0; y < trace.mesh_y; ++y) {
+    NoC::dram_list[y] = {0, y};
+    NoC::dram_list[trace.mesh_y + y] = {static_cast<mlen_t>(trace.mesh_x - 1),
+                                        y};
+  }
+  Topology::d2d_bw = MAX(noc_bw / 4, 1);
+  Topology::init();
+
+  std::ofstream csv(trace_name + ".nocsim.csv");
+  NoCSim sim(static_cast<std::size_t>(channels));
+  sim.simulate(trace, static_cast<std::size_t>(max_sends), 8, std::cout, csv);
+  return 0;
+}
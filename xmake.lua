@@ -55,6 +55,28 @@ target("stschedule")
         set_symbols("debug")
     end
 
+-- NoC模拟器：重放芯粒追踪文件
+target("nocsim")
+    set_kind("binary")
+    add_files("src/*.cpp|main.cpp")
+    add_files("src/nns/*.cpp")
+    add_files("src/json/*.cpp")
+    add_files("tools/nocsim.cpp")
+    add_includedirs("include")
+    add_syslinks("pthread", "m")
+    set_targetdir("$(builddir)")
+    set_objectdir("$(builddir)/objects")
+
+    if is_mode("debug") then
+        add_defines("DEBUG")
+        set_symbols("debug")
+        set_optimize("none")
+    end
+
+    if is_mode("release") or is_mode("releasedbg") then
+        set_optimize("aggressive")
+    end
+
 -- 自定义任务：清理构建文件
 task("clean-all")
     on_run(function ()